@@ -0,0 +1,38 @@
+#pragma once
+#include "sdf.h"
+
+// Enclosed volume (divergence theorem, exact for closed meshes) and surface
+// area, summed in one pass over the faces.
+struct MeshMetrics {
+  double volume = 0;
+  double area = 0;
+};
+MeshMetrics CalculateMeshMetrics(const Mesh &mesh);
+
+// Samples below isolevel, each counting for one voxel of the grid spacing.
+struct GridMetrics {
+  size_t insideVoxels = 0;
+  double volume = 0;
+};
+GridMetrics CalculateGridMetrics(const Image3D &image, float isolevel = 0);
+
+struct CheeseMetrics {
+  double volume = 0;
+  double area = 0;
+  size_t insideVoxels = 0;
+  double gridVolume = 0;
+  // volume of the cylinder the cheese is carved from.
+  double envelopeVolume = 0;
+  // fraction of the envelope carved by the eyes, from the mesh volume.
+  double porosity = 0;
+  // pores reaching into the cylinder, overlapping pores count separately.
+  size_t eyesCount = 0;
+  // mean of the mesh vertices and their standard deviation along the axes,
+  // off the cylinder axis when the eyes are unevenly spread.
+  Vec3f centroid = {0, 0, 0};
+  Vec3f spread = {0, 0, 0};
+};
+CheeseMetrics CalculateCheeseMetrics(const Cheese &cheese, const Mesh &mesh,
+                                     const Image3D &image);
+// A single line JSON object with the fields of the metrics.
+std::string ToJson(const CheeseMetrics &metrics);
@@ -0,0 +1,12 @@
+#pragma once
+#include "sdf.h"
+
+// Quadric error edge-collapse simplification. The mesh is welded first, then
+// edges are collapsed by increasing error until the mesh has at most
+// targetFacesCount faces, or until the next collapses would cost more than
+// maxError (a distance in the mesh units). A collapse is skipped if it would
+// flip a face or join the edge ends by another path than its faces (the link
+// condition), so it adds no non-manifold edge. The collapses run in parallel
+// over slabs of the mesh, the result does not depend on the threads count.
+Mesh Decimate(const Mesh &mesh, size_t targetFacesCount,
+              float maxError = FLT_MAX);
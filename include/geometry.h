@@ -1,8 +1,10 @@
 #pragma once
 
+#include <algorithm>
 #include <cassert>
 #include <cfloat>
 #include <chrono>
+#include <cmath>
 #include <cstdio>
 
 template <typename F> struct privDefer {
@@ -212,6 +214,16 @@ Mat4 LookAt(const Vec3f &eye, const Vec3f &center, const Vec3f &up);
 
 bool Intersect(const Vec3f planePt, const Vec3f planeN, const Vec3f p0,
                const Vec3f p1, const Vec3f p2, Segment3D &out);
+// Also gives the edges of the triangle the segment starts and ends on, edge i
+// going from point i to point (i + 1) % 3, or 3 + i if it starts or ends
+// exactly on point i. The points on the plane count as above it, and the
+// segment goes along planeN x (p1 - p0) x (p2 - p0).
+bool Intersect(const Vec3f planePt, const Vec3f planeN, const Vec3f p0,
+               const Vec3f p1, const Vec3f p2, Segment3D &out,
+               uint8_t &startEdge, uint8_t &endEdge);
+// Whether Intersect gives a segment, without computing it.
+bool Crosses(const Vec3f planePt, const Vec3f planeN, const Vec3f p0,
+             const Vec3f p1, const Vec3f p2);
 
 float PointToCylinderDistance(const Vec3f &p, const Vec3f &center, float radius,
                               float height);
@@ -42,10 +42,13 @@ struct MeshRenderInfo {
   size_t facesCount = 0;
   size_t verticesCount = 0;
   BBox box;
-  size_t id;
+  // id of the uploaded mesh, 0 if none.
+  size_t id = 0;
 
   MeshRenderInfo() = default;
   MeshRenderInfo(Mesh &mesh);
+  // deletes the GPU buffers.
+  void Release();
 };
 
 struct Camera {
@@ -61,6 +64,7 @@ struct Camera {
   float farClipRatio = DEFAULT_FAR_CLIP;
 
   Mat4 GetViewMatrix() const { return viewMatrix; }
+  Vec3f GetPosition() const;
   Mat4 GetProjectionMatrix(size_t width, size_t height) const;
   void FitBBox(const BBox &box);
   void GetFrame(Vec3f &look, Vec3f &up, Vec3f &right) const;
@@ -0,0 +1,50 @@
+#pragma once
+#include "sdf.h"
+
+// Index based half-edge mesh. The half-edges of face f are 3f, 3f + 1 and
+// 3f + 2, so the next half-edge and the face of a half-edge are implicit.
+struct HalfEdgeMesh {
+  static constexpr uint32_t INVALID = UINT32_MAX;
+
+  std::vector<Vec3f> vertices;
+  // the vertex every half-edge starts from.
+  std::vector<uint32_t> origins;
+  // the opposite half-edge, INVALID on the borders and on the edges shared by
+  // more than two faces.
+  std::vector<uint32_t> twins;
+  // one half-edge starting from every vertex, a border one if there is one.
+  // INVALID for the vertices without faces.
+  std::vector<uint32_t> vertexEdges;
+
+  inline size_t FacesCount() const { return origins.size() / 3; }
+  static inline uint32_t Face(uint32_t h) { return h / 3; }
+  static inline uint32_t Next(uint32_t h) { return h - h % 3 + (h + 1) % 3; }
+  static inline uint32_t Prev(uint32_t h) { return h - h % 3 + (h + 2) % 3; }
+  inline uint32_t Twin(uint32_t h) const { return twins[h]; }
+  inline uint32_t Origin(uint32_t h) const { return origins[h]; }
+  inline uint32_t Target(uint32_t h) const { return origins[Next(h)]; }
+  inline bool IsBorder(uint32_t h) const { return twins[h] == INVALID; }
+
+  // Calls f(h) for the half-edges starting from vertex v, turning around it
+  // from vertexEdges[v]. Only the first fan of a non-manifold vertex is
+  // visited.
+  template <typename F> void ForEachOutgoing(uint32_t v, F f) const {
+    const uint32_t first = vertexEdges[v];
+    uint32_t h = first;
+    while (h != INVALID) {
+      f(h);
+      h = twins[Prev(h)];
+      if (h == first) {
+        break;
+      }
+    }
+  }
+};
+
+// The faces with a repeated vertex are dropped.
+HalfEdgeMesh BuildHalfEdgeMesh(const Mesh &mesh);
+Mesh ToMesh(const HalfEdgeMesh &mesh);
+// Builds the half-edge mesh of mesh and checks that every twin is the reverse
+// half-edge of its own twin, that every vertex edge starts from its vertex,
+// and that ToMesh gives back the faces without a repeated vertex.
+bool CheckHalfEdgeRoundTrip(const Mesh &mesh);
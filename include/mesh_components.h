@@ -0,0 +1,23 @@
+#pragma once
+#include "sdf.h"
+
+// The parts of a mesh whose faces are connected through shared vertices (a
+// single shared vertex is enough), numbered in the order of their first face.
+struct MeshComponents {
+  // component of every face.
+  std::vector<uint32_t> faceLabels;
+  std::vector<size_t> facesCount;
+  // signed volume enclosed by every component, negative for the inward facing
+  // shells around the voids. Only meaningful for closed components.
+  std::vector<double> volumes;
+
+  size_t Count() const { return facesCount.size(); }
+};
+
+// Parallel union-find over the vertices of the faces.
+MeshComponents LabelComponents(const Mesh &mesh);
+
+// Removes the faces of the components enclosing less than minVolume (in
+// absolute value), and the vertices left unused. Returns the number of
+// components removed.
+size_t RemoveSmallComponents(Mesh &mesh, float minVolume);
@@ -0,0 +1,13 @@
+#pragma once
+#include "sdf.h"
+
+// Average cache miss ratio: the vertices transformed per face by a FIFO
+// post-transform cache of cacheSize entries, between 0.5 and 3.
+float CalculateACMR(const Mesh &mesh, size_t cacheSize = 32);
+
+// Reorders the faces to reuse the post-transform vertex cache (Tipsify).
+void OptimizeVertexCache(Mesh &mesh, size_t cacheSize = 32);
+
+// Renumbers the vertices in the order the faces first use them, the vertices
+// not used by any face are dropped.
+void OptimizeVertexFetch(Mesh &mesh);
@@ -0,0 +1,9 @@
+#pragma once
+#include "geometry.h"
+
+// Reductions over vertex arrays, vectorised with SSE2 when available and split
+// over the threads for large arrays.
+BBox CalculateBBox(const Vec3f *vertices, size_t count);
+Vec3f CalculateCentroid(const Vec3f *vertices, size_t count);
+// Covariance of the vertices around their centroid.
+Mat3 CalculateCovariance(const Vec3f *vertices, size_t count);
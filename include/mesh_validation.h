@@ -0,0 +1,28 @@
+#pragma once
+#include "sdf.h"
+
+// Topology defects of a mesh. The checks work on the vertex indices, so a mesh
+// with duplicated vertices (the raw marching cubes output) must be welded
+// first, or all its edges are boundary edges.
+struct MeshValidation {
+  size_t edgesCount = 0;
+  // edges used by a single face.
+  size_t boundaryEdges = 0;
+  // edges shared by more than two faces.
+  size_t nonManifoldEdges = 0;
+  // vertices whose faces form several fans only joined at the vertex.
+  size_t nonManifoldVertices = 0;
+  // faces with a repeated vertex or with collinear vertices.
+  size_t degenerateFaces = 0;
+  // edges between two faces going along the edge in the same direction.
+  size_t flippedEdges = 0;
+
+  bool IsClosed() const { return boundaryEdges == 0; }
+  bool IsManifold() const {
+    return nonManifoldEdges == 0 && nonManifoldVertices == 0;
+  }
+  bool IsOriented() const { return flippedEdges == 0; }
+  bool IsWatertight() const { return IsClosed() && IsManifold(); }
+};
+
+MeshValidation ValidateMesh(const Mesh &mesh);
@@ -0,0 +1,216 @@
+#pragma once
+#include <omp.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// The slots [first, last) of an output accumulated by a thread.
+template <typename T> struct Window {
+  size_t first = 0;
+  size_t last = 0;
+  std::vector<T> values;
+
+  inline size_t Size() const { return last - first; }
+  inline T &operator[](size_t slot) { return values[slot - first]; }
+};
+
+namespace parallel_detail {
+// The range of count items taken by the calling thread of a parallel region.
+inline void ThreadRange(size_t count, size_t &first, size_t &last) {
+  const size_t thread = omp_get_thread_num();
+  const size_t threads = omp_get_num_threads();
+  first = count * thread / threads;
+  last = count * (thread + 1) / threads;
+}
+
+// Sets the window of every thread to the slots listed by slots(i, emit) for
+// its range of the items, returns false if the windows together are larger
+// than limit: the items next to each other then use scattered slots, as the
+// faces and the vertices of a mesh welded by position.
+template <typename T, typename Slots>
+bool ThreadWindows(size_t count, const Slots &slots, size_t limit,
+                   std::vector<Window<T>> &windows) {
+  windows.assign(omp_get_max_threads(), Window<T>{});
+  size_t total = 0;
+#pragma omp parallel num_threads(int(windows.size())) reduction(+ : total)
+  {
+    size_t first, last;
+    ThreadRange(count, first, last);
+    size_t lo = SIZE_MAX, hi = 0;
+    for (size_t i = first; i < last; ++i) {
+      slots(i, [&](size_t slot) {
+        lo = (std::min)(lo, slot);
+        hi = (std::max)(hi, slot);
+      });
+    }
+    Window<T> &window = windows[omp_get_thread_num()];
+    window.first = lo <= hi ? lo : 0;
+    window.last = lo <= hi ? hi + 1 : 0;
+    total += window.Size();
+  }
+  return total <= limit;
+}
+
+// Calls f(slot, window) for the slots of the windows in the range [first,
+// last), the windows taken in the threads order.
+template <typename T, typename F>
+void ForEachWindowSlot(std::vector<Window<T>> &windows, size_t threadsCount,
+                       size_t first, size_t last, const F &f) {
+  for (size_t t = 0; t < threadsCount; ++t) {
+    Window<T> &w = windows[t];
+    const size_t begin = (std::max)(first, w.first);
+    const size_t end = (std::min)(last, w.last);
+    for (size_t slot = begin; slot < end; ++slot) {
+      f(slot, w);
+    }
+  }
+}
+} // namespace parallel_detail
+
+/*
+    Counting sort of count items into rowsCount rows in parallel, item i going
+    to the rows listed by rows(i, emit): the items of row r are
+    items[offsets[r]] to items[offsets[r + 1] - 1], in increasing order. Every
+    thread counts its range of the items in a window of the rows, the windows
+    become the cursors of the threads by a prefix sum over the rows and the
+    threads, and every thread writes the same range of the items again. When
+    the windows would take more memory than the rows, the rows are counted and
+    filled with atomics and sorted.
+*/
+template <typename Rows>
+void FillRows(size_t count, size_t rowsCount, const Rows &rows,
+              std::vector<uint32_t> &offsets, std::vector<uint32_t> &items) {
+  using namespace parallel_detail;
+  std::vector<Window<uint32_t>> windows;
+  const bool windowed =
+      ThreadWindows(count, rows, rowsCount + count, windows);
+  offsets.assign(rowsCount + 1, 0);
+  std::vector<uint32_t> cursors;
+#pragma omp parallel num_threads(int(windows.size()))
+  {
+    const size_t threadsCount = omp_get_num_threads();
+    Window<uint32_t> &window = windows[omp_get_thread_num()];
+    size_t first, last, rowsFirst, rowsLast;
+    ThreadRange(count, first, last);
+    ThreadRange(rowsCount, rowsFirst, rowsLast);
+    if (windowed) {
+      window.values.assign(window.Size(), 0);
+      for (size_t i = first; i < last; ++i) {
+        rows(i, [&](size_t row) { window[row]++; });
+      }
+    } else {
+      for (size_t i = first; i < last; ++i) {
+        rows(i, [&](size_t row) {
+#pragma omp atomic
+          offsets[row + 1]++;
+        });
+      }
+    }
+#pragma omp barrier
+    if (windowed) {
+      ForEachWindowSlot(windows, threadsCount, rowsFirst, rowsLast,
+                        [&](size_t row, Window<uint32_t> &w) {
+                          offsets[row + 1] += w[row];
+                        });
+    }
+#pragma omp barrier
+#pragma omp single
+    {
+      for (size_t row = 0; row < rowsCount; ++row) {
+        offsets[row + 1] += offsets[row];
+      }
+      items.resize(offsets[rowsCount]);
+      if (!windowed) {
+        cursors.assign(offsets.begin(), offsets.end() - 1);
+      }
+    }
+    if (windowed) {
+      // the cursor of a thread in a row starts after the items of the row
+      // taken by the previous threads.
+      std::vector<uint32_t> rowCursors(offsets.begin() + rowsFirst,
+                                       offsets.begin() + rowsLast);
+      ForEachWindowSlot(windows, threadsCount, rowsFirst, rowsLast,
+                        [&](size_t row, Window<uint32_t> &w) {
+                          const uint32_t rowCount = w[row];
+                          w[row] = rowCursors[row - rowsFirst];
+                          rowCursors[row - rowsFirst] += rowCount;
+                        });
+#pragma omp barrier
+      for (size_t i = first; i < last; ++i) {
+        rows(i, [&](size_t row) { items[window[row]++] = uint32_t(i); });
+      }
+    } else {
+      for (size_t i = first; i < last; ++i) {
+        rows(i, [&](size_t row) {
+          uint32_t cursor;
+#pragma omp atomic capture
+          cursor = cursors[row]++;
+          items[cursor] = uint32_t(i);
+        });
+      }
+#pragma omp barrier
+#pragma omp for schedule(dynamic, 1024)
+      for (int64_t row = 0; row < int64_t(rowsCount); ++row) {
+        std::sort(items.begin() + offsets[row],
+                  items.begin() + offsets[row + 1]);
+      }
+    }
+  }
+}
+
+/*
+    Accumulates count items into the slots of result in parallel without
+    atomics, item i adding the values given by values(i, emit) to the slots
+    listed by slots(i, emit), with merge(accumulated, value). Every thread
+    accumulates its range of the items in a window of the slots, then merges
+    the windows over its own range of the slots in the threads order, so the
+    result only depends on the threads count. When the windows would take
+    more memory than the result and the items, the items of every slot are
+    listed by FillRows and gathered in their order instead.
+*/
+template <typename T, typename Slots, typename Values, typename Merge>
+void ParallelScatter(size_t count, std::vector<T> &result, const Slots &slots,
+                     const Values &values, const Merge &merge) {
+  using namespace parallel_detail;
+  const size_t slotsCount = result.size();
+  std::vector<Window<T>> windows;
+  if (!ThreadWindows(count, slots, slotsCount + count, windows)) {
+    std::vector<uint32_t> offsets, items;
+    FillRows(count, slotsCount, slots, offsets, items);
+#pragma omp parallel for schedule(dynamic, 1024)
+    for (int64_t slot = 0; slot < int64_t(slotsCount); ++slot) {
+      for (uint32_t k = offsets[slot]; k < offsets[slot + 1]; ++k) {
+        // an item listed twice in the row already gave all its values.
+        if (k > offsets[slot] && items[k] == items[k - 1]) {
+          continue;
+        }
+        values(items[k], [&](size_t s, const T &value) {
+          if (s == size_t(slot)) {
+            merge(result[slot], value);
+          }
+        });
+      }
+    }
+    return;
+  }
+#pragma omp parallel num_threads(int(windows.size()))
+  {
+    const size_t threadsCount = omp_get_num_threads();
+    Window<T> &window = windows[omp_get_thread_num()];
+    window.values.assign(window.Size(), T{});
+    size_t first, last;
+    ThreadRange(count, first, last);
+    for (size_t i = first; i < last; ++i) {
+      values(i, [&](size_t slot, const T &value) {
+        merge(window[slot], value);
+      });
+    }
+#pragma omp barrier
+    ThreadRange(slotsCount, first, last);
+    ForEachWindowSlot(windows, threadsCount, first, last,
+                      [&](size_t slot, Window<T> &w) {
+                        merge(result[slot], w[slot]);
+                      });
+  }
+}
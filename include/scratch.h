@@ -0,0 +1,37 @@
+#pragma once
+#include <vector>
+
+namespace scratch_detail {
+// the functions freeing the scratch objects used by the calling thread.
+inline std::vector<void (*)()> &Releasers() {
+  thread_local std::vector<void (*)()> releasers;
+  return releasers;
+}
+} // namespace scratch_detail
+
+// A per-thread object kept alive between calls, so that the pipeline stages
+// reuse its memory instead of allocating on every run. Every user passes its
+// own Tag type so that two users never share an object, the content left by
+// the previous call is unspecified. The memory is held until ReleaseScratch.
+template <typename Tag, typename T> T &Scratch() {
+  thread_local T object;
+  thread_local bool registered = false;
+  if (!registered) {
+    registered = true;
+    scratch_detail::Releasers().push_back([] { Scratch<Tag, T>() = T{}; });
+  }
+  return object;
+}
+
+template <typename Tag, typename T> std::vector<T> &ScratchVector() {
+  return Scratch<Tag, std::vector<T>>();
+}
+
+// Frees the scratch objects of the OpenMP threads, to be called between the
+// pipeline stages when their memory is not worth keeping for the next run.
+inline void ReleaseScratch() {
+#pragma omp parallel
+  for (void (*release)() : scratch_detail::Releasers()) {
+    release();
+  }
+}
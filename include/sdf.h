@@ -1,7 +1,7 @@
 #pragma once
 #include <algorithm>
 #include <array>
-#include <set>
+#include <string>
 #include <vector>
 
 #include "geometry.h"
@@ -31,12 +31,27 @@ struct ColorImage {
   inline Color At(size_t x, size_t y) const { return data[LinearIndex(x, y)]; }
 };
 
+// Values range of the image samples grouped in blocks of BLOCK_SIZE^3 cells,
+// neighbour blocks share their boundary samples. A block whose range doesn't
+// contain the isolevel can't intersect the isosurface.
+struct BlocksRange {
+  static constexpr size_t BLOCK_SIZE = 8;
+  size_t blocks[3] = {};
+  std::vector<float> min, max;
+
+  inline size_t Count() const { return blocks[0] * blocks[1] * blocks[2]; }
+  inline bool Contains(size_t block, float isolevel) const {
+    return min[block] < isolevel && max[block] >= isolevel;
+  }
+};
+
 struct Image3D {
   std::vector<float> data;
   size_t size[3] = {};
   float spacing[3] = {};
   float origin[3] = {};
   float min = 0, max = 0;
+  BlocksRange blocksRange;
 
   inline void UpdateMinMax() {
     const auto p = std::minmax_element(data.begin(), data.end());
@@ -58,22 +73,94 @@ struct Mesh {
   using Triangle = std::array<uint32_t, 3>;
   std::vector<Vec3f> vertices;
   std::vector<Triangle> faces;
+  // bounds of the vertices set by the extractors, invalid when unknown. Code
+  // moving or dropping vertices resets it.
+  BBox box;
   std::string name;
   Color color;
-  size_t id;
+  // 0 for the meshes that were not generated.
+  size_t id = 0;
   bool visible = true;
 };
 
-struct CheeseSlice {
-  std::vector<Segment2D> segments;
-  BBox box;
+// A mesh extracted in chunks of CHUNK_BLOCKS^3 cell blocks of its image, so
+// that an edit only re-extracts the chunks it touches. Re-extracted chunks
+// stay dirty until their GPU buffers are updated.
+struct ChunkedMesh {
+  static constexpr size_t CHUNK_BLOCKS = 4;
+  // the cells of a chunk at lod l span 2^l image samples.
+  static constexpr uint8_t MAX_LOD = 3;
+  struct Chunk {
+    Mesh mesh;
+    BBox box;
+    uint8_t lod = 0;
+    // bit f is set if the face f (-x, +x, -y, +y, -z, +z) borders a chunk
+    // with a finer lod.
+    uint8_t transitions = 0;
+    bool dirty = true;
+  };
+  size_t size[3] = {};
+  std::vector<Chunk> chunks;
+
+  inline size_t LinearIndex(size_t x, size_t y, size_t z) const {
+    return x + y * size[0] + z * size[0] * size[1];
+  }
+  // all the chunks in a single mesh.
+  Mesh Merge() const;
 };
 
-struct Connectivity {
-  struct VertexNeighbours {
-    std::set<size_t> adjacentFaces;
+// All the slices of a cheese in flat arrays. The segments of slice s are
+// [segmentOffsets[s], segmentOffsets[s + 1]) in starts and ends, with the
+// material on their left, sorted by contour so that the segments of a contour
+// follow each other, linked end to start. The contours of slice s are
+// [contourOffsets[s], contourOffsets[s + 1]), and contour c is made of the
+// segments [contourSegments[c], contourSegments[c + 1]): its points are their
+// starts, then the end of the last one unless the contour is closed.
+struct SliceSet {
+  std::vector<Vec2f> starts;
+  std::vector<Vec2f> ends;
+  std::vector<uint32_t> segmentOffsets;
+  std::vector<uint32_t> contourOffsets;
+  std::vector<uint32_t> contourSegments;
+  // signed area, positive for the outer contours (counter clockwise) and
+  // negative for the holes, given a mesh with outward faces.
+  std::vector<float> contourAreas;
+  std::vector<uint8_t> contourClosed;
+  std::vector<BBox> boxes;
+  // coordinate of every plane along the slicing direction.
+  std::vector<float> positions;
+
+  inline size_t Count() const { return positions.size(); }
+  inline size_t ContoursCount() const { return contourAreas.size(); }
+  inline bool IsHole(size_t contour) const {
+    return contourAreas[contour] < 0;
+  }
+  void Clear();
+};
+
+// Compressed sparse rows: the items adjacent to vertex v are sorted in
+// items[offsets[v]] to items[offsets[v + 1] - 1].
+struct Adjacency {
+  std::vector<uint32_t> offsets;
+  std::vector<uint32_t> items;
+
+  struct Row {
+    const uint32_t *first;
+    const uint32_t *last;
+    inline const uint32_t *begin() const { return first; }
+    inline const uint32_t *end() const { return last; }
+    inline size_t size() const { return last - first; }
   };
-  std::vector<VertexNeighbours> pointCells;
+  inline Row operator[](size_t v) const {
+    return Row{items.data() + offsets[v], items.data() + offsets[v + 1]};
+  }
+};
+
+struct Connectivity {
+  // faces around every vertex.
+  Adjacency pointCells;
+  // vertices sharing an edge with every vertex, only built on request.
+  Adjacency pointNeighbours;
 };
 
 // SDF
@@ -98,6 +185,17 @@ struct Cheese {
     }
   }
 
+  // bounds of the cylinder the pores are carved in.
+  BBox Box() const {
+    return BBox{Vec3f{-cylinderRadius, -cylinderRadius, 0},
+                Vec3f{cylinderRadius, cylinderRadius, cylinderHeight}};
+  }
+
+  BBox PoreBBox(size_t pore) const {
+    const Vec3f r{poresRadius, poresRadius, poresRadius};
+    return BBox{poresCenters[pore] - r, poresCenters[pore] + r};
+  }
+
   float Eval(float x, float y, float z) const {
     float poresUnion = FLT_MAX;
     const Vec3f p{x, y, z};
@@ -122,16 +220,94 @@ struct Cheese {
   }
 };
 
+// The overloads taking an output argument overwrite it and reuse the memory it
+// already holds, so that regenerating into the same objects does not allocate
+// once their capacity is large enough.
+
+// The cached mesh box if valid, computed otherwise.
 BBox CalculateBBox(const Mesh &mesh);
+// Merges the vertices sharing exactly the same position.
+Mesh WeldVertices(const Mesh &mesh);
+void WeldVertices(const Mesh &mesh, Mesh &result);
 std::vector<Vec3f> CalculateFacesNormals(const Mesh &mesh);
-Connectivity BuildConnectivity(const Mesh &mesh);
-std::vector<Vec3f> CalculateVertexNormals(const Mesh &m, const Connectivity &c);
+Connectivity BuildConnectivity(const Mesh &mesh, bool withNeighbours = false);
+void BuildConnectivity(const Mesh &mesh, Connectivity &connectivity,
+                       bool withNeighbours = false);
+// Area weighted average of the normals of the faces around every vertex.
+std::vector<Vec3f> CalculateVertexNormals(const Mesh &mesh);
+void CalculateVertexNormals(const Mesh &mesh, std::vector<Vec3f> &normals);
+
+BlocksRange CalculateBlocksRange(const Image3D &image);
+void CalculateBlocksRange(const Image3D &image, BlocksRange &range);
 
 Image3D CreateSDFGrid(const Cheese &cheese, const float min[3],
                       const float max[3], const float spacing[3]);
+void CreateSDFGrid(const Cheese &cheese, const float min[3], const float max[3],
+                   const float spacing[3], Image3D &image);
 
 Mesh MarchingCubes(const Image3D &image);
+void MarchingCubes(const Image3D &image, Mesh &mesh);
+ChunkedMesh MarchingCubesChunks(const Image3D &image);
+// Evaluates again the cheese on the image samples inside region, and around
+// it for as long as the values change, then re-extracts the chunks of the
+// mesh using the changed samples.
+void UpdateRegion(const Cheese &cheese, const BBox &region, Image3D &image,
+                  ChunkedMesh &mesh);
+// Sets the lod of every chunk, after making the lods of neighbour chunks
+// differ by one at most. The chunks whose lod or transitions change are
+// re-extracted, with transition cells closing the cracks at the finer chunks.
+void SetChunksLod(const Image3D &image, const std::vector<uint8_t> &lods,
+                  ChunkedMesh &mesh);
+Mesh SurfaceNets(const Image3D &image);
+void SurfaceNets(const Image3D &image, Mesh &mesh);
 
-std::vector<CheeseSlice> Slice(const Mesh &mesh, size_t count, Orientation dir);
+// The segments are chained into contours by the mesh edges they cross,
+// matched by the positions of the edge vertices, so a mesh with vertices
+// duplicated at the same position (as the unwelded marching cubes output)
+// gives the same contours as the welded one.
+SliceSet Slice(const Mesh &mesh, size_t count, Orientation dir);
+void Slice(const Mesh &mesh, size_t count, Orientation dir, SliceSet &slices);
+// Slices along any direction: plane i goes through origin + normal * step * i
+// and its points are given in the frame (u, v) around origin, with u made
+// orthogonal to normal and v = normal x u.
+SliceSet Slice(const Mesh &mesh, const Vec3f &origin, const Vec3f &normal,
+               const Vec3f &u, float step, size_t count);
+void Slice(const Mesh &mesh, const Vec3f &origin, const Vec3f &normal,
+           const Vec3f &u, float step, size_t count, SliceSet &slices);
+// Same with the planes at the given sorted distances from origin.
+void Slice(const Mesh &mesh, const Vec3f &origin, const Vec3f &normal,
+           const Vec3f &u, const std::vector<float> &positions,
+           SliceSet &slices);
+// Layer positions along normal (the coordinates dot(p, normal)), from the
+// lowest vertex up, for the planes of Slice with a zero origin. A layer of
+// thickness h leaves a staircase of h |n . normal| on a face of unit normal n,
+// every layer is as thick as it can be while keeping that cusp below maxCusp
+// on the faces it covers, within [minThickness, maxThickness].
+std::vector<float> AdaptiveLayers(const Mesh &mesh, const Vec3f &normal,
+                                  float minThickness, float maxThickness,
+                                  float maxCusp);
+// Contours straight from the SDF of the planes orthogonal to the axis dir at
+// the coordinates first + step * i, in the frame of Slice along that axis.
+// Marching squares runs on every plane, either interpolated between the
+// layers of the grid or sampled from the cheese with the spacing of
+// CreateSDFGrid. No mesh is built and every thread only holds the samples of
+// one plane, the segments of its planes are gathered into the set once they
+// are all counted.
+SliceSet MarchingSquares(const Image3D &image, Orientation dir, float first,
+                         float step, size_t count);
+void MarchingSquares(const Image3D &image, Orientation dir, float first,
+                     float step, size_t count, SliceSet &slices);
+SliceSet MarchingSquares(const Cheese &cheese, const float min[3],
+                         const float max[3], const float spacing[3],
+                         Orientation dir, float first, float step,
+                         size_t count);
+void MarchingSquares(const Cheese &cheese, const float min[3],
+                     const float max[3], const float spacing[3],
+                     Orientation dir, float first, float step, size_t count,
+                     SliceSet &slices);
+// Douglas-Peucker simplification of the contours of slices, dropping the
+// points that stay within tolerance of the chord replacing them. The closed
+// contours keep three points at least.
+void SimplifyContours(SliceSet &slices, float tolerance);
 void Slice(const Image3D &image, Orientation dir, size_t id, ColorImage &out,
            bool globalRemap);
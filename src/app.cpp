@@ -3,11 +3,20 @@
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_opengl3.h>
 
+#include <algorithm>
 #include <cassert>
+#include <memory>
 // Include glfw3.h after our OpenGL definitions
 #include <GLFW/glfw3.h>
 
+#include "cheese_metrics.h"
+#include "decimation.h"
 #include "graphics.h"
+#include "half_edge.h"
+#include "mesh_components.h"
+#include "mesh_optimizer.h"
+#include "mesh_validation.h"
+#include "scratch.h"
 
 // surface with wireframes shaders
 static const char *wires_fs = R"V0G0N(
@@ -31,12 +40,15 @@ void main()
 }
 )V0G0N";
 
+// positions come quantised in the mesh bounding box, see MeshRenderInfo.
 static const char *wires_vs = R"V0G0N(
 #version 330 core
-in vec4 position;
+layout(location = 0) in vec3 position;
+uniform vec3 boxMin;
+uniform vec3 boxSize;
 void main()
 {
-    gl_Position = position;
+    gl_Position = vec4(boxMin + position * boxSize, 1.0);
 }
 )V0G0N";
 
@@ -127,12 +139,49 @@ struct View3DState {
   bool redraw = true;
   Camera camera;
   MeshRenderInfo surfacesRenderInfo;
+  // one entry per chunk of an edited mesh, rendered instead of the surfaces.
+  std::vector<MeshRenderInfo> chunksRenderInfo;
 
   void Init() {
     buffer.Init(width, height);
     program.Init(wires_gs, wires_vs, wires_fs);
   }
 
+  // reorders the mesh for the GPU vertex caches and uploads it.
+  void Upload(Mesh &mesh) {
+    const float acmr = CalculateACMR(mesh);
+    OptimizeVertexCache(mesh);
+    OptimizeVertexFetch(mesh);
+    printf("ACMR: %f -> %f\n", acmr, CalculateACMR(mesh));
+    surfacesRenderInfo.Release();
+    surfacesRenderInfo = MeshRenderInfo(mesh);
+    ClearChunks();
+    redraw = true;
+  }
+
+  // uploads the chunks re-extracted since the last upload only.
+  void UploadChunks(ChunkedMesh &chunked) {
+    chunksRenderInfo.resize(chunked.chunks.size());
+    for (size_t i = 0; i < chunked.chunks.size(); ++i) {
+      ChunkedMesh::Chunk &chunk = chunked.chunks[i];
+      if (chunk.dirty) {
+        chunksRenderInfo[i].Release();
+        if (!chunk.mesh.faces.empty()) {
+          chunksRenderInfo[i] = MeshRenderInfo(chunk.mesh);
+        }
+        chunk.dirty = false;
+        redraw = true;
+      }
+    }
+  }
+
+  void ClearChunks() {
+    for (MeshRenderInfo &info : chunksRenderInfo) {
+      info.Release();
+    }
+    chunksRenderInfo.clear();
+  }
+
   void Fit() {
     BBox b = surfacesRenderInfo.box;
     if (b.IsValid()) {
@@ -224,10 +273,23 @@ struct View3DState {
       program.SetUniformV3f("lightPos", lightPos.data);
       program.SetUniformV3f("lightColor", lighColour.data);
 
-      if (mesh.id == surfacesRenderInfo.id && mesh.visible) {
-        const float meshColor[3]{mesh.color.r / 255.f, mesh.color.g / 255.f,
-                                 mesh.color.b / 255.f};
-        program.SetUniformV3f("objectColor", meshColor);
+      const float meshColor[3]{mesh.color.r / 255.f, mesh.color.g / 255.f,
+                               mesh.color.b / 255.f};
+      program.SetUniformV3f("objectColor", meshColor);
+      if (!chunksRenderInfo.empty()) {
+        if (mesh.visible) {
+          for (const MeshRenderInfo &info : chunksRenderInfo) {
+            if (info.facesCount) {
+              program.SetUniformV3f("boxMin", info.box.min.data);
+              program.SetUniformV3f("boxSize", info.box.Size().data);
+              RenderMesh(buffer, program, info);
+            }
+          }
+        }
+      } else if (mesh.id == surfacesRenderInfo.id && mesh.visible &&
+                 surfacesRenderInfo.facesCount) {
+        program.SetUniformV3f("boxMin", surfacesRenderInfo.box.min.data);
+        program.SetUniformV3f("boxSize", surfacesRenderInfo.box.Size().data);
         RenderMesh(buffer, program, surfacesRenderInfo);
       }
     }
@@ -244,16 +306,59 @@ struct State {
     float poresRadius = 2;
     float cylinderHeight = 20;
     float cylinderRadius = 40;
+    // X, Y, Z or 3 for the planes orthogonal to sliceNormal.
     int direction = 2;
+    float sliceNormal[3] = {0, 1, 1};
+    int extractor = 0;
+    float decimationRatio = 0.25f;
     int slicesCount = 20;
     bool showSlices = false;
     bool globalRangeRemap = true;
     int sliceIndex = 0;
+    int poreIndex = 0;
+    float poreCenter[3] = {0, 0, 10};
+    bool levelOfDetail = false;
+    // chunks closer than this distance to the camera are at full detail, the
+    // lod increases every time the distance doubles.
+    float lodDistance = 40;
+    // the smaller disconnected parts of the mesh are dropped, 0 keeps all.
+    float minComponentVolume = 0;
+    // the axis slices come from the mesh (0), or straight from the SDF grid
+    // (1) or the cheese (2) without the mesh.
+    int sliceSource = 0;
+    // min and max layer thickness, and max staircase error.
+    bool adaptiveLayers = false;
+    float layerThickness[3] = {0.2f, 2, 0.1f};
+    // max distance of the contours simplification, 0 keeps all the points.
+    float contourTolerance = 0;
+    // keeps the scratch memory of the pipeline stages for the next runs.
+    bool keepScratch = false;
   } gui;
 
+  std::unique_ptr<Cheese> cheese;
   Image3D sdfGrid;
+  // the raw marching cubes output, kept to reuse its memory.
+  Mesh extracted;
   Mesh mesh;
-  std::vector<CheeseSlice> slices;
+  // the chunks of the mesh after pore edits, mesh is stale until merged.
+  ChunkedMesh chunkedMesh;
+  bool meshStale = false;
+  // the mesh is the marching cubes surface of sdfGrid, the only one that pore
+  // edits and the level of detail can re-extract by chunks.
+  bool chunkable = false;
+  // the lods of the chunks, kept to reuse its memory every frame.
+  std::vector<uint8_t> lods;
+  // a button ran a pipeline stage this frame, its scratch memory is released
+  // at the end of the frame unless kept.
+  bool ranPipeline = false;
+  SliceSet slices;
+  // the report of the last "Validate", empty until then.
+  std::string validationReport;
+  // the last "Metrics" results, empty until then.
+  std::string metricsReport;
+  std::string metricsJson;
+  // the layers count of the last adaptive slicing against uniform layers.
+  std::string layersReport;
   View3DState view3d;
   SliceViewState sliceView;
 
@@ -263,6 +368,188 @@ struct State {
     assert(view3d.program.valid);
   }
 
+  // moves a pore and re-meshes only the chunks around it, for a chunkable
+  // mesh.
+  void MovePore(size_t pore, const Vec3f &center) {
+    assert(chunkable);
+    if (chunkedMesh.chunks.empty()) {
+      chunkedMesh = MarchingCubesChunks(sdfGrid);
+    }
+    BBox region = cheese->PoreBBox(pore);
+    cheese->poresCenters[pore] = center;
+    const BBox moved = cheese->PoreBBox(pore);
+    for (size_t i = 0; i < 3; ++i) {
+      region.min[i] = (std::min)(region.min[i], moved.min[i]);
+      region.max[i] = (std::max)(region.max[i], moved.max[i]);
+    }
+    UpdateRegion(*cheese, region, sdfGrid, chunkedMesh);
+    meshStale = true;
+    view3d.UploadChunks(chunkedMesh);
+    sliceView.SliceImage(sdfGrid, gui.globalRangeRemap);
+  }
+
+  // picks the lod of every chunk from its distance to the camera.
+  void UpdateLod() {
+    const Vec3f eye = view3d.camera.GetPosition();
+    lods.assign(chunkedMesh.chunks.size(), 0);
+    for (size_t i = 0; i < lods.size(); ++i) {
+      const BBox &box = chunkedMesh.chunks[i].box;
+      Vec3f nearest;
+      for (size_t j = 0; j < 3; ++j) {
+        nearest[j] = (std::max)(box.min[j], (std::min)(eye[j], box.max[j]));
+      }
+      const float ratio = Length(nearest - eye) / gui.lodDistance;
+      if (gui.levelOfDetail && ratio >= 1) {
+        lods[i] = uint8_t((std::min)(
+            std::log2(ratio) + 1, float(ChunkedMesh::MAX_LOD)));
+      }
+    }
+    SetChunksLod(sdfGrid, lods, chunkedMesh);
+    view3d.UploadChunks(chunkedMesh);
+  }
+
+  // a cheese with the pores parameters, without its grid or mesh.
+  void NewCheese() {
+    cheese = std::make_unique<Cheese>(gui.poresCount, gui.poresRadius,
+                                      gui.cylinderHeight, gui.cylinderRadius);
+  }
+
+  // the planes along an axis are spread over the cheese box within the grid
+  // ranges, for every slice source, so that a slice keeps its height whatever
+  // it is sliced from. False if there is nothing to slice.
+  bool AxisPlanes(size_t dir, float &first, float &step) const {
+    if (!cheese || gui.slicesCount <= 0) {
+      return false;
+    }
+    const BBox box = cheese->Box();
+    const float *ranges[3] = {gui.xRange, gui.yRange, gui.zRange};
+    const float lo = (std::max)(box.min[dir], ranges[dir][0]);
+    const float hi = (std::min)(box.max[dir], ranges[dir][1]);
+    first = lo;
+    step = (hi - lo) / gui.slicesCount;
+    return hi > lo;
+  }
+
+  // slices along the chosen axis from the chosen source, or the mesh along
+  // the normal or with the adaptive layers.
+  void SliceCheese() {
+    const size_t dir = gui.direction;
+    if (gui.direction == 3 || gui.adaptiveLayers || gui.sliceSource == 0) {
+      MergeChunks();
+      SliceMesh();
+      return;
+    }
+    if (gui.sliceSource == 2 && !cheese) {
+      NewCheese();
+    }
+    float first, step;
+    if (!AxisPlanes(dir, first, step)) {
+      slices.Clear();
+    } else if (gui.sliceSource == 1) {
+      MarchingSquares(sdfGrid, Orientation(dir), first, step, gui.slicesCount,
+                      slices);
+    } else {
+      const float min[3]{gui.xRange[0], gui.yRange[0], gui.zRange[0]};
+      const float max[3]{gui.xRange[1], gui.yRange[1], gui.zRange[1]};
+      const float spacing[3]{gui.xRange[2], gui.yRange[2], gui.zRange[2]};
+      MarchingSquares(*cheese, min, max, spacing, Orientation(dir), first,
+                      step, gui.slicesCount, slices);
+    }
+  }
+
+  // the coordinates along normal spanned by the mesh box.
+  void BoxRange(const Vec3f &normal, float &lo, float &hi) const {
+    const BBox box = CalculateBBox(mesh);
+    lo = FLT_MAX, hi = -FLT_MAX;
+    for (size_t i = 0; i < 8; ++i) {
+      const Vec3f corner{(i & 1) ? box.max.x : box.min.x,
+                         (i & 2) ? box.max.y : box.min.y,
+                         (i & 4) ? box.max.z : box.min.z};
+      lo = (std::min)(lo, DotProduct(corner, normal));
+      hi = (std::max)(hi, DotProduct(corner, normal));
+    }
+  }
+
+  // slices the mesh along the chosen axis or normal, with the planes spread
+  // like in AxisPlanes, over the mesh box along a normal, or placed by the
+  // adaptive layers.
+  void SliceMesh() {
+    Vec3f normal{0, 0, 0};
+    Vec3f u{0, 0, 0};
+    if (gui.direction == 3) {
+      normal =
+          Vec3f{gui.sliceNormal[0], gui.sliceNormal[1], gui.sliceNormal[2]};
+      // a zero normal typed in gives no slices.
+      const float length2 = Length2(normal);
+      if (!(length2 > 0) || !std::isfinite(length2)) {
+        slices.Clear();
+        return;
+      }
+      normal = Normalised(normal);
+      u = Vec3f{1, 0, 0};
+    } else {
+      normal[gui.direction] = 1;
+      u[(gui.direction + 1) % 3] = 1;
+    }
+    float lo, hi;
+    BoxRange(normal, lo, hi);
+    if (gui.adaptiveLayers) {
+      const std::vector<float> positions =
+          AdaptiveLayers(mesh, normal, gui.layerThickness[0],
+                         gui.layerThickness[1], gui.layerThickness[2]);
+      Slice(mesh, Vec3f{0, 0, 0}, normal, u, positions, slices);
+      // uniform layers keeping the cusp on the flattest faces are all as thin
+      // as allowed.
+      char report[128];
+      snprintf(report, sizeof(report),
+               "%zu adaptive layers, %.0f uniform layers of the min thickness",
+               positions.size(),
+               std::floor((hi - lo) / gui.layerThickness[0]) + 1);
+      layersReport = positions.empty() ? "" : report;
+      return;
+    }
+    if (gui.direction != 3) {
+      float first, step;
+      if (!AxisPlanes(gui.direction, first, step)) {
+        slices.Clear();
+        return;
+      }
+      Slice(mesh, normal * first, normal, u, step, gui.slicesCount, slices);
+      return;
+    }
+    Slice(mesh, normal * lo, normal, u, (hi - lo) / gui.slicesCount,
+          gui.slicesCount, slices);
+  }
+
+  void RemoveCrumbs() {
+    if (gui.minComponentVolume > 0) {
+      RemoveSmallComponents(mesh, gui.minComponentVolume);
+    }
+  }
+
+  // makes mesh up to date with the edited chunks.
+  void MergeChunks() {
+    if (meshStale) {
+      // the coarser chunks of the level of detail are left for the view, the
+      // whole grid is extracted at full resolution instead.
+      const bool coarse = std::any_of(
+          chunkedMesh.chunks.begin(), chunkedMesh.chunks.end(),
+          [](const ChunkedMesh::Chunk &chunk) { return chunk.lod > 0; });
+      if (coarse) {
+        MarchingCubes(sdfGrid, extracted);
+      } else {
+        extracted = chunkedMesh.Merge();
+      }
+      const Color color = mesh.color;
+      std::string name = std::move(mesh.name);
+      WeldVertices(extracted, mesh);
+      mesh.name = std::move(name);
+      mesh.color = color;
+      RemoveCrumbs();
+      meshStale = false;
+    }
+  }
+
   void Update() {
     ImGuiStyle &style = ImGui::GetStyle();
     style.FrameRounding = style.GrabRounding = 12;
@@ -288,28 +575,41 @@ struct State {
       ImGui::SameLine();
       ImGui::BeginChild("3D View", viewsSize);
       if (gui.showSlices) {
-        if (!slices.empty()) {
+        if (slices.Count() > 0) {
           if (ImGui::SliderInt("Index", &gui.sliceIndex, 0,
-                               slices.size() - 1)) {
+                               slices.Count() - 1)) {
           }
           ImDrawList *draw_list = ImGui::GetWindowDrawList();
           const ImVec2 canvasPt = ImGui::GetCursorScreenPos();
           const ImVec2 canvasSize = ImGui::GetWindowSize();
           const ImU32 YELLOW = ImColor(255, 255, 0);
+          const ImU32 ORANGE = ImColor(255, 128, 0);
           const float thickness = 1.0f;
-          const auto &slice = slices[gui.sliceIndex];
-          const auto box = slice.box;
-          const auto boxSize = slice.box.Size();
-          for (const Segment2D s : slices[gui.sliceIndex].segments) {
-            ImVec2 start((s.start.x - box.min.x) / boxSize[0],
-                         (s.start.y - box.min.x) / boxSize[1]);
-            ImVec2 end((s.end.x - box.min.x) / boxSize[0],
-                       (s.end.y - box.min.x) / boxSize[1]);
-            start[0] = start[0] * canvasSize[0] + canvasPt[0];
-            start[1] = start[1] * canvasSize[1] + canvasPt[1];
-            end[0] = end[0] * canvasSize[0] + canvasPt[0];
-            end[1] = end[1] * canvasSize[1] + canvasPt[1];
-            draw_list->AddLine(start, end, YELLOW, thickness);
+          const size_t slice =
+              (std::min)(size_t(gui.sliceIndex), slices.Count() - 1);
+          const auto box = slices.boxes[slice];
+          const auto boxSize = box.Size();
+          const auto ToCanvas = [&](const Vec2f &p) {
+            return ImVec2(
+                (p.x - box.min.x) / boxSize[0] * canvasSize[0] + canvasPt[0],
+                (p.y - box.min.y) / boxSize[1] * canvasSize[1] + canvasPt[1]);
+          };
+          struct Polyline;
+          std::vector<ImVec2> &points = ScratchVector<Polyline, ImVec2>();
+          for (size_t c = slices.contourOffsets[slice];
+               c < slices.contourOffsets[slice + 1]; ++c) {
+            const size_t first = slices.contourSegments[c];
+            const size_t last = slices.contourSegments[c + 1];
+            points.clear();
+            for (size_t k = first; k < last; ++k) {
+              points.push_back(ToCanvas(slices.starts[k]));
+            }
+            if (!slices.contourClosed[c]) {
+              points.push_back(ToCanvas(slices.ends[last - 1]));
+            }
+            draw_list->AddPolyline(points.data(), points.size(),
+                                   slices.IsHole(c) ? ORANGE : YELLOW,
+                                   slices.contourClosed[c], thickness);
           }
         }
       } else {
@@ -319,6 +619,10 @@ struct State {
       ImGui::EndGroup();
     }
 
+    if (!chunkedMesh.chunks.empty()) {
+      UpdateLod();
+    }
+
     {
       ImGui::BeginChild("Controls", ImVec2(-1, height * 0.2));
 
@@ -356,39 +660,169 @@ struct State {
       if (ImGui::RadioButton("Z", gui.direction == 2)) {
         gui.direction = 2;
       }
+      ImGui::SameLine();
+      if (ImGui::RadioButton("Normal", gui.direction == 3)) {
+        gui.direction = 3;
+      }
+      ImGui::SameLine();
+      ImGui::InputFloat3("Slicing normal", gui.sliceNormal);
       ImGui::InputInt("Slices count", &gui.slicesCount);
+      ImGui::Checkbox("Adaptive layers", &gui.adaptiveLayers);
+      ImGui::SameLine();
+      ImGui::InputFloat3("Min, max thickness and cusp", gui.layerThickness);
+      ImGui::InputFloat("Contour tolerance", &gui.contourTolerance, 0, 0, "%g");
+      ImGui::InputFloat("Decimation ratio", &gui.decimationRatio);
+      ImGui::InputFloat("Min component volume", &gui.minComponentVolume, 0, 0,
+                        "%g");
+      ImGui::Text("Surface extraction:");
+      ImGui::SameLine();
+      if (ImGui::RadioButton("Marching cubes", gui.extractor == 0)) {
+        gui.extractor = 0;
+      }
+      ImGui::SameLine();
+      if (ImGui::RadioButton("Surface nets", gui.extractor == 1)) {
+        gui.extractor = 1;
+      }
+
+      ImGui::InputInt("Pore", &gui.poreIndex);
+      ImGui::SameLine();
+      ImGui::InputFloat3("Pore center", gui.poreCenter);
+      ImGui::SameLine();
+      if (ImGui::Button("Move pore") && cheese && chunkable &&
+          gui.poreIndex >= 0 &&
+          gui.poreIndex < int(cheese->poresCenters.size())) {
+        ranPipeline = true;
+        MovePore(gui.poreIndex, Vec3f{gui.poreCenter[0], gui.poreCenter[1],
+                                      gui.poreCenter[2]});
+      }
+
+      if (ImGui::Checkbox("Level of detail", &gui.levelOfDetail) &&
+          gui.levelOfDetail && cheese && chunkable &&
+          chunkedMesh.chunks.empty()) {
+        ranPipeline = true;
+        chunkedMesh = MarchingCubesChunks(sdfGrid);
+      }
+      ImGui::SameLine();
+      ImGui::InputFloat("LOD distance", &gui.lodDistance);
+      if (cheese && !chunkable) {
+        ImGui::TextDisabled("Pore edits and level of detail need a marching "
+                           "cubes mesh that is not decimated.");
+      }
 
       if (ImGui::Button("Cheese")) {
-        const Cheese cheeseFn(gui.poresCount, gui.poresRadius,
-                              gui.cylinderHeight, gui.cylinderRadius);
+        ranPipeline = true;
+        NewCheese();
         const float min[3]{gui.xRange[0], gui.yRange[0], gui.zRange[0]};
         const float max[3]{gui.xRange[1], gui.yRange[1], gui.zRange[1]};
         const float spacing[3]{gui.xRange[2], gui.yRange[2], gui.zRange[2]};
-        sdfGrid = CreateSDFGrid(cheeseFn, min, max, spacing);
-        mesh = MarchingCubes(sdfGrid);
+        CreateSDFGrid(*cheese, min, max, spacing, sdfGrid);
+        chunkedMesh = ChunkedMesh{};
+        meshStale = false;
+        chunkable = gui.extractor == 0;
+        if (gui.extractor == 0) {
+          MarchingCubes(sdfGrid, extracted);
+          WeldVertices(extracted, mesh);
+        } else {
+          SurfaceNets(sdfGrid, mesh);
+        }
+        RemoveCrumbs();
         mesh.name = "Cheese";
-        view3d.surfacesRenderInfo = MeshRenderInfo(mesh);
-        view3d.redraw = true;
+        view3d.Upload(mesh);
         view3d.Fit();
+        if (gui.levelOfDetail && chunkable) {
+          chunkedMesh = MarchingCubesChunks(sdfGrid);
+        }
 
         sliceView.maxIndex = sdfGrid.size[2] - 1;
         sliceView.index = 0;
         sliceView.SliceImage(sdfGrid, gui.globalRangeRemap);
       }
       ImGui::SameLine();
+      if (ImGui::Button("Decimate")) {
+        ranPipeline = true;
+        MergeChunks();
+        chunkedMesh = ChunkedMesh{};
+        chunkable = false;
+        const size_t target = mesh.faces.size() * gui.decimationRatio;
+        mesh = Decimate(mesh, target);
+        view3d.Upload(mesh);
+      }
+      ImGui::SameLine();
       if (ImGui::Button("Slice")) {
-        slices = Slice(mesh, gui.slicesCount, Orientation(gui.direction));
+        ranPipeline = true;
+        SliceCheese();
+        SimplifyContours(slices, gui.contourTolerance);
         gui.showSlices = true;
       }
       ImGui::SameLine();
+      ImGui::Text("from");
+      ImGui::SameLine();
+      ImGui::RadioButton("mesh", &gui.sliceSource, 0);
+      ImGui::SameLine();
+      ImGui::RadioButton("SDF grid", &gui.sliceSource, 1);
+      ImGui::SameLine();
+      ImGui::RadioButton("cheese", &gui.sliceSource, 2);
+      ImGui::SameLine();
+      if (ImGui::Button("Validate")) {
+        ranPipeline = true;
+        MergeChunks();
+        const MeshValidation v = ValidateMesh(mesh);
+        const bool halfEdges = CheckHalfEdgeRoundTrip(mesh);
+        char report[256];
+        snprintf(report, sizeof(report),
+                 "%s: %zu boundary edges, %zu non-manifold edges, %zu "
+                 "non-manifold vertices, %zu degenerate faces, %zu flipped "
+                 "edges, half-edge round trip %s",
+                 v.IsWatertight() && v.IsOriented() ? "Watertight" : "Invalid",
+                 v.boundaryEdges, v.nonManifoldEdges, v.nonManifoldVertices,
+                 v.degenerateFaces, v.flippedEdges,
+                 halfEdges ? "ok" : "failed");
+        validationReport = report;
+      }
+      ImGui::SameLine();
+      if (ImGui::Button("Metrics") && cheese) {
+        ranPipeline = true;
+        MergeChunks();
+        const CheeseMetrics m = CalculateCheeseMetrics(*cheese, mesh, sdfGrid);
+        char report[256];
+        snprintf(report, sizeof(report),
+                 "Volume %.4g (grid %.4g), area %.4g, porosity %.2f%%, "
+                 "%zu eyes, centroid (%.3g, %.3g, %.3g)",
+                 m.volume, m.gridVolume, m.area, 100 * m.porosity,
+                 m.eyesCount, m.centroid.x, m.centroid.y, m.centroid.z);
+        metricsReport = report;
+        metricsJson = ToJson(m);
+        // one line per wheel on the standard output for the scripts.
+        printf("%s\n", metricsJson.c_str());
+        fflush(stdout);
+      }
+      ImGui::SameLine();
       ImGui::Checkbox("Show slices", &gui.showSlices);
       ImGui::SameLine();
       ImGui::Checkbox("Global SDF slice remap", &gui.globalRangeRemap);
+      if (!validationReport.empty()) {
+        ImGui::TextWrapped("%s", validationReport.c_str());
+      }
+      if (gui.adaptiveLayers && !layersReport.empty()) {
+        ImGui::TextWrapped("%s", layersReport.c_str());
+      }
+      if (!metricsReport.empty()) {
+        ImGui::TextWrapped("%s", metricsReport.c_str());
+        ImGui::SameLine();
+        if (ImGui::Button("Copy JSON")) {
+          ImGui::SetClipboardText(metricsJson.c_str());
+        }
+      }
 
+      ImGui::Checkbox("Keep scratch buffers", &gui.keepScratch);
       ImGui::Text("Application average: %.1f FPS", ImGui::GetIO().Framerate);
       ImGui::EndChild();
     }
     ImGui::End();
+    if (ranPipeline && !gui.keepScratch) {
+      ReleaseScratch();
+    }
+    ranPipeline = false;
   }
 };
 
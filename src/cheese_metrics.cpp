@@ -0,0 +1,86 @@
+#include "cheese_metrics.h"
+#include "mesh_statistics.h"
+
+#include <cmath>
+
+MeshMetrics CalculateMeshMetrics(const Mesh &mesh) {
+  TIME_BLOCK("Mesh metrics")
+  const int64_t facesCount = mesh.faces.size();
+  double volume = 0, area = 0;
+#pragma omp parallel for reduction(+ : volume, area)
+  for (int64_t i = 0; i < facesCount; ++i) {
+    const Mesh::Triangle &t = mesh.faces[i];
+    const Vec3f &a = mesh.vertices[t[0]];
+    const Vec3f &b = mesh.vertices[t[1]];
+    const Vec3f &c = mesh.vertices[t[2]];
+    volume += DotProduct(a, CrossProduct(b, c));
+    area += std::sqrt(Length2(CrossProduct(b - a, c - a)));
+  }
+  return MeshMetrics{volume / 6, area / 2};
+}
+
+GridMetrics CalculateGridMetrics(const Image3D &image, float isolevel) {
+  TIME_BLOCK("Grid metrics")
+  const int64_t count = image.data.size();
+  size_t inside = 0;
+#pragma omp parallel for reduction(+ : inside)
+  for (int64_t i = 0; i < count; ++i) {
+    inside += image.data[i] < isolevel;
+  }
+  GridMetrics result;
+  result.insideVoxels = inside;
+  result.volume = double(inside) * image.spacing[0] * image.spacing[1] *
+                  image.spacing[2];
+  return result;
+}
+
+CheeseMetrics CalculateCheeseMetrics(const Cheese &cheese, const Mesh &mesh,
+                                     const Image3D &image) {
+  const MeshMetrics meshMetrics = CalculateMeshMetrics(mesh);
+  const GridMetrics gridMetrics = CalculateGridMetrics(image);
+  CheeseMetrics result;
+  result.volume = meshMetrics.volume;
+  result.area = meshMetrics.area;
+  result.insideVoxels = gridMetrics.insideVoxels;
+  result.gridVolume = gridMetrics.volume;
+  result.envelopeVolume = PI * cheese.cylinderRadius *
+                          cheese.cylinderRadius * cheese.cylinderHeight;
+  if (result.envelopeVolume > 0) {
+    result.porosity = 1 - result.volume / result.envelopeVolume;
+  }
+  // a pore reaches into the cylinder if the point of the cylinder closest to
+  // its center is inside it.
+  for (const Vec3f &center : cheese.poresCenters) {
+    const float radial = std::sqrt(center.x * center.x + center.y * center.y);
+    const float dr = (std::max)(radial - cheese.cylinderRadius, 0.0f);
+    const float dz = center.z < 0 ? -center.z
+                     : center.z > cheese.cylinderHeight
+                         ? center.z - cheese.cylinderHeight
+                         : 0;
+    result.eyesCount +=
+        dr * dr + dz * dz < cheese.poresRadius * cheese.poresRadius;
+  }
+  result.centroid =
+      CalculateCentroid(mesh.vertices.data(), mesh.vertices.size());
+  const Mat3 covariance =
+      CalculateCovariance(mesh.vertices.data(), mesh.vertices.size());
+  for (size_t k = 0; k < 3; ++k) {
+    result.spread[k] = std::sqrt(covariance.elements[k][k]);
+  }
+  return result;
+}
+
+std::string ToJson(const CheeseMetrics &metrics) {
+  const Vec3f &c = metrics.centroid;
+  const Vec3f &s = metrics.spread;
+  char json[768];
+  snprintf(json, sizeof(json),
+           "{\"volume\": %.9g, \"area\": %.9g, \"insideVoxels\": %zu, "
+           "\"gridVolume\": %.9g, \"envelopeVolume\": %.9g, "
+           "\"porosity\": %.9g, \"eyesCount\": %zu, "
+           "\"centroid\": [%.9g, %.9g, %.9g], \"spread\": [%.9g, %.9g, %.9g]}",
+           metrics.volume, metrics.area, metrics.insideVoxels,
+           metrics.gridVolume, metrics.envelopeVolume, metrics.porosity,
+           metrics.eyesCount, c.x, c.y, c.z, s.x, s.y, s.z);
+  return json;
+}
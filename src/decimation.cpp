@@ -0,0 +1,517 @@
+#include "decimation.h"
+
+#include <omp.h>
+#include "parallel.h"
+
+#include <cassert>
+#include <cmath>
+
+namespace {
+// symmetric 4x4 matrix stored as its upper triangle.
+struct Quadric {
+  double m[10] = {};
+
+  Quadric() = default;
+  // quadric of the plane a*x + b*y + c*z + d = 0.
+  Quadric(double a, double b, double c, double d) {
+    m[0] = a * a, m[1] = a * b, m[2] = a * c, m[3] = a * d;
+    m[4] = b * b, m[5] = b * c, m[6] = b * d;
+    m[7] = c * c, m[8] = c * d;
+    m[9] = d * d;
+  }
+  Quadric operator+(const Quadric &b) const {
+    Quadric r;
+    for (size_t i = 0; i < 10; ++i) {
+      r.m[i] = m[i] + b.m[i];
+    }
+    return r;
+  }
+  double Error(const Vec3f &p) const {
+    const double x = p.x, y = p.y, z = p.z;
+    return m[0] * x * x + 2 * m[1] * x * y + 2 * m[2] * x * z +
+           2 * m[3] * x + m[4] * y * y + 2 * m[5] * y * z + 2 * m[6] * y +
+           m[7] * z * z + 2 * m[8] * z + m[9];
+  }
+  // the point minimising the error, false if the system is singular.
+  bool Minimiser(Vec3f &p) const {
+    auto Det = [](double a, double b, double c, double d, double e, double f,
+                  double g, double h, double i) {
+      return a * (e * i - f * h) - b * (d * i - f * g) + c * (d * h - e * g);
+    };
+    const double det =
+        Det(m[0], m[1], m[2], m[1], m[4], m[5], m[2], m[5], m[7]);
+    if (std::abs(det) < 1e-12) {
+      return false;
+    }
+    p.x = Det(-m[3], m[1], m[2], -m[6], m[4], m[5], -m[8], m[5], m[7]) / det;
+    p.y = Det(m[0], -m[3], m[2], m[1], -m[6], m[5], m[2], -m[8], m[7]) / det;
+    p.z = Det(m[0], m[1], -m[3], m[1], m[4], -m[6], m[2], m[5], -m[8]) / det;
+    return true;
+  }
+};
+
+struct Decimator {
+  struct Triangle {
+    uint32_t v[3];
+    double error[4];
+    Vec3f normal;
+    bool deleted = false;
+    bool dirty = false;
+  };
+  struct Vertex {
+    Vec3f p;
+    Quadric q;
+    uint32_t refsStart = 0;
+    uint32_t refsCount = 0;
+    // 0 if the refs are in refs, s + 1 if they are in slabRefs[s].
+    uint32_t refsList = 0;
+    bool border = false;
+  };
+  // a triangle using a vertex, and which of its corners the vertex is.
+  struct Ref {
+    uint32_t triangle;
+    uint32_t corner;
+  };
+
+  std::vector<Triangle> triangles;
+  std::vector<Vertex> vertices;
+  std::vector<Ref> refs;
+  // the refs written by the collapses of every slab since the last UpdateRefs.
+  std::vector<std::vector<Ref>> slabRefs;
+  // the slab of every vertex in the current iteration, and whether all the
+  // vertices of its triangles are in that slab.
+  std::vector<uint32_t> slabs;
+  std::vector<uint8_t> insideSlab;
+  BBox box;
+  size_t deletedCount = 0;
+
+  Decimator(const Mesh &mesh) : box(CalculateBBox(mesh)) {
+    vertices.resize(mesh.vertices.size());
+    for (size_t i = 0; i < mesh.vertices.size(); ++i) {
+      vertices[i].p = mesh.vertices[i];
+    }
+    triangles.reserve(mesh.faces.size());
+    for (const Mesh::Triangle &f : mesh.faces) {
+      // faces collapsed by the welding carry no surface.
+      if (f[0] == f[1] || f[1] == f[2] || f[2] == f[0]) {
+        continue;
+      }
+      Triangle t;
+      t.v[0] = f[0], t.v[1] = f[1], t.v[2] = f[2];
+      triangles.push_back(t);
+    }
+  }
+
+  size_t FacesCount() const { return triangles.size() - deletedCount; }
+
+  std::vector<Ref> &RefsList(const Vertex &v) {
+    return v.refsList == 0 ? refs : slabRefs[v.refsList - 1];
+  }
+  const std::vector<Ref> &RefsList(const Vertex &v) const {
+    return v.refsList == 0 ? refs : slabRefs[v.refsList - 1];
+  }
+
+  // calls f(triangle, ref) for the triangles of v not deleted.
+  template <typename F>
+  void ForEachTriangle(const Vertex &v, const F &f) const {
+    const std::vector<Ref> &list = RefsList(v);
+    for (uint32_t k = 0; k < v.refsCount; ++k) {
+      const Ref &r = list[v.refsStart + k];
+      if (!triangles[r.triangle].deleted) {
+        f(triangles[r.triangle], r);
+      }
+    }
+  }
+
+  double EdgeError(uint32_t i0, uint32_t i1, Vec3f &p) const {
+    const Vertex &v0 = vertices[i0];
+    const Vertex &v1 = vertices[i1];
+    const Quadric q = v0.q + v1.q;
+    if (!(v0.border && v1.border) && q.Minimiser(p)) {
+      return q.Error(p);
+    }
+    const Vec3f candidates[3] = {v0.p, v1.p, (v0.p + v1.p) * 0.5f};
+    double best = DBL_MAX;
+    for (const Vec3f &c : candidates) {
+      const double error = q.Error(c);
+      if (error < best) {
+        best = error;
+        p = c;
+      }
+    }
+    return best;
+  }
+
+  void UpdateErrors(Triangle &t) const {
+    Vec3f p;
+    for (size_t j = 0; j < 3; ++j) {
+      t.error[j] = EdgeError(t.v[j], t.v[(j + 1) % 3], p);
+    }
+    t.error[3] = (std::min)(t.error[0], (std::min)(t.error[1], t.error[2]));
+  }
+
+  // removes the deleted triangles and rebuilds the vertex to triangles refs,
+  // listing the corners of the triangles by vertex.
+  void UpdateRefs() {
+    size_t dst = 0;
+    for (size_t i = 0; i < triangles.size(); ++i) {
+      if (!triangles[i].deleted) {
+        triangles[dst++] = triangles[i];
+      }
+    }
+    triangles.resize(dst);
+    deletedCount = 0;
+    slabRefs.clear();
+
+    assert(triangles.size() <= UINT32_MAX / 3);
+    std::vector<uint32_t> offsets, corners;
+    FillRows(
+        3 * triangles.size(), vertices.size(),
+        [&](size_t i, const auto &emit) { emit(triangles[i / 3].v[i % 3]); },
+        offsets, corners);
+    const int64_t refsCount = corners.size();
+    refs.resize(refsCount);
+#pragma omp parallel for
+    for (int64_t k = 0; k < refsCount; ++k) {
+      refs[k] = Ref{corners[k] / 3, corners[k] % 3};
+    }
+    const int64_t verticesCount = vertices.size();
+#pragma omp parallel for
+    for (int64_t i = 0; i < verticesCount; ++i) {
+      Vertex &v = vertices[i];
+      v.refsStart = offsets[i];
+      v.refsCount = offsets[i + 1] - offsets[i];
+      v.refsList = 0;
+    }
+  }
+
+  // the quadrics, borders and edge errors of the starting mesh.
+  void Init() {
+    UpdateRefs();
+
+    const int64_t trianglesCount = triangles.size();
+    std::vector<Quadric> planes(trianglesCount);
+#pragma omp parallel for
+    for (int64_t i = 0; i < trianglesCount; ++i) {
+      Triangle &t = triangles[i];
+      const Vec3f p0 = vertices[t.v[0]].p;
+      const Vec3f n = CrossProduct(vertices[t.v[1]].p - p0,
+                                   vertices[t.v[2]].p - p0);
+      if (Length2(n) == 0) {
+        t.normal = Vec3f{0, 0, 0};
+        continue;
+      }
+      t.normal = Normalised(n);
+      planes[i] = Quadric(t.normal.x, t.normal.y, t.normal.z,
+                          -DotProduct(t.normal, p0));
+    }
+
+    const int64_t verticesCount = vertices.size();
+#pragma omp parallel for
+    for (int64_t i = 0; i < verticesCount; ++i) {
+      Vertex &v = vertices[i];
+      for (uint32_t k = 0; k < v.refsCount; ++k) {
+        v.q = v.q + planes[refs[v.refsStart + k].triangle];
+      }
+      // a vertex is on the border if one of its edges has a single face.
+      for (uint32_t k = 0; k < v.refsCount && !v.border; ++k) {
+        const Ref &r = refs[v.refsStart + k];
+        const uint32_t next = triangles[r.triangle].v[(r.corner + 1) % 3];
+        size_t count = 0;
+        for (uint32_t l = 0; l < v.refsCount; ++l) {
+          const Triangle &t = triangles[refs[v.refsStart + l].triangle];
+          count += t.v[0] == next || t.v[1] == next || t.v[2] == next;
+        }
+        v.border = count == 1;
+      }
+    }
+
+#pragma omp parallel for
+    for (int64_t i = 0; i < trianglesCount; ++i) {
+      UpdateErrors(triangles[i]);
+    }
+  }
+
+  // true if moving vertex i0 to p flips or degenerates one of its triangles
+  // not shared with i1, marks in `removed` the ones that are shared.
+  bool Flipped(const Vec3f &p, uint32_t i1, const Vertex &v0,
+               std::vector<bool> &removed) const {
+    const std::vector<Ref> &list = RefsList(v0);
+    for (uint32_t k = 0; k < v0.refsCount; ++k) {
+      const Ref &r = list[v0.refsStart + k];
+      const Triangle &t = triangles[r.triangle];
+      if (t.deleted) {
+        continue;
+      }
+      const uint32_t id1 = t.v[(r.corner + 1) % 3];
+      const uint32_t id2 = t.v[(r.corner + 2) % 3];
+      if (id1 == i1 || id2 == i1) {
+        removed[k] = true;
+        continue;
+      }
+      removed[k] = false;
+      const Vec3f d1 = vertices[id1].p - p;
+      const Vec3f d2 = vertices[id2].p - p;
+      if (Length2(d1) == 0 || Length2(d2) == 0) {
+        return true;
+      }
+      const Vec3f n1 = Normalised(d1);
+      const Vec3f n2 = Normalised(d2);
+      if (std::abs(DotProduct(n1, n2)) > 0.999f) {
+        return true;
+      }
+      if (Length2(t.normal) == 0) {
+        continue;
+      }
+      const Vec3f n = Normalised(CrossProduct(n1, n2));
+      if (DotProduct(n, t.normal) < 0.2f) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // true if the vertices adjacent to both i0 and i1 are the ones opposite the
+  // edge in its triangles, at most two, so that the collapse keeps the mesh
+  // manifold (the link condition).
+  bool Linked(uint32_t i0, uint32_t i1, std::vector<uint32_t> &around,
+              std::vector<uint32_t> &opposite) const {
+    around.clear();
+    opposite.clear();
+    ForEachTriangle(vertices[i0], [&](const Triangle &t, const Ref &) {
+      const bool shared = t.v[0] == i1 || t.v[1] == i1 || t.v[2] == i1;
+      for (const uint32_t w : t.v) {
+        if (w != i0 && w != i1) {
+          (shared ? opposite : around).push_back(w);
+        }
+      }
+    });
+    if (opposite.size() > 2) {
+      return false;
+    }
+    bool linked = true;
+    ForEachTriangle(vertices[i1], [&](const Triangle &t, const Ref &) {
+      for (const uint32_t w : t.v) {
+        if (w != i0 && w != i1 &&
+            std::find(around.begin(), around.end(), w) != around.end() &&
+            std::find(opposite.begin(), opposite.end(), w) == opposite.end()) {
+          linked = false;
+        }
+      }
+    });
+    return linked;
+  }
+
+  // points the triangles of v at i0, dropping the ones marked in `removed`,
+  // and appends their refs to list.
+  void UpdateTriangles(uint32_t i0, const Vertex &v,
+                       const std::vector<bool> &removed, std::vector<Ref> &list,
+                       size_t &deleted) {
+    const std::vector<Ref> &refsList = RefsList(v);
+    for (uint32_t k = 0; k < v.refsCount; ++k) {
+      const Ref r = refsList[v.refsStart + k];
+      Triangle &t = triangles[r.triangle];
+      if (t.deleted) {
+        continue;
+      }
+      if (removed[k]) {
+        t.deleted = true;
+        deleted++;
+        continue;
+      }
+      t.v[r.corner] = i0;
+      t.dirty = true;
+      const Vec3f p0 = vertices[t.v[0]].p;
+      const Vec3f n = CrossProduct(vertices[t.v[1]].p - p0,
+                                   vertices[t.v[2]].p - p0);
+      t.normal = Length2(n) == 0 ? Vec3f{0, 0, 0} : Normalised(n);
+      UpdateErrors(t);
+      list.push_back(r);
+    }
+  }
+
+  // collapses the edges below threshold of the triangles items[first] to
+  // items[last - 1], all in the slab, until budget faces are deleted. Only
+  // the edges between vertices inside the slab are collapsed, so the
+  // collapses only touch the triangles and vertices of the slab, and the
+  // vertices stay inside it.
+  size_t CollapseSlab(uint32_t slab, const std::vector<uint32_t> &items,
+                      size_t first, size_t last, double threshold,
+                      size_t budget) {
+    std::vector<bool> removed0, removed1;
+    std::vector<uint32_t> around, opposite;
+    std::vector<Ref> &list = slabRefs[slab];
+    size_t deleted = 0;
+    for (size_t k = first; k < last && deleted < budget; ++k) {
+      const Triangle &t = triangles[items[k]];
+      if (t.error[3] > threshold || t.deleted || t.dirty) {
+        continue;
+      }
+      for (size_t j = 0; j < 3; ++j) {
+        if (t.error[j] > threshold) {
+          continue;
+        }
+        const uint32_t i0 = t.v[j];
+        const uint32_t i1 = t.v[(j + 1) % 3];
+        Vertex &v0 = vertices[i0];
+        const Vertex &v1 = vertices[i1];
+        if (v0.border != v1.border || !insideSlab[i0] || !insideSlab[i1] ||
+            !Linked(i0, i1, around, opposite)) {
+          continue;
+        }
+        Vec3f p;
+        EdgeError(i0, i1, p);
+        removed0.assign(v0.refsCount, false);
+        removed1.assign(v1.refsCount, false);
+        if (Flipped(p, i1, v0, removed0) || Flipped(p, i0, v1, removed1)) {
+          continue;
+        }
+
+        v0.p = p;
+        v0.q = v0.q + v1.q;
+        const size_t start = list.size();
+        UpdateTriangles(i0, v0, removed0, list, deleted);
+        UpdateTriangles(i0, v1, removed1, list, deleted);
+        const size_t count = list.size() - start;
+        if (count <= v0.refsCount) {
+          // reuse the slot of v0 if the new refs fit in it.
+          std::copy(list.begin() + start, list.end(),
+                    RefsList(v0).begin() + v0.refsStart);
+          list.resize(start);
+        } else {
+          v0.refsStart = start;
+          v0.refsList = slab + 1;
+        }
+        v0.refsCount = count;
+        break;
+      }
+    }
+    return deleted;
+  }
+
+  // Sets the slabs of the vertices along the longest axis of the box, the
+  // slab bounds shifted by offset times their width, and the vertices
+  // inside them.
+  void UpdateSlabs(size_t slabsCount, float offset) {
+    const Vec3f size = box.max - box.min;
+    const size_t axis = size.x >= size.y && size.x >= size.z ? 0
+                        : size.y >= size.z                   ? 1
+                                                             : 2;
+    const float scale = size[axis] > 0 ? slabsCount / size[axis] : 0;
+    const int64_t verticesCount = vertices.size();
+    slabs.resize(verticesCount);
+#pragma omp parallel for
+    for (int64_t i = 0; i < verticesCount; ++i) {
+      const float x = (vertices[i].p[axis] - box.min[axis]) * scale + offset;
+      slabs[i] = std::clamp<int64_t>(int64_t(x), 0, slabsCount - 1);
+    }
+    insideSlab.resize(verticesCount);
+#pragma omp parallel for
+    for (int64_t i = 0; i < verticesCount; ++i) {
+      const uint32_t slab = slabs[i];
+      bool inside = true;
+      ForEachTriangle(vertices[i], [&](const Triangle &t, const Ref &) {
+        inside = inside && slabs[t.v[0]] == slab && slabs[t.v[1]] == slab &&
+                 slabs[t.v[2]] == slab;
+      });
+      insideSlab[i] = inside;
+    }
+  }
+
+  void Run(size_t targetFacesCount, float maxError) {
+    constexpr size_t MAX_ITERATIONS = 100;
+    constexpr double AGGRESSIVENESS = 7;
+    // faces per slab, the slabs count only depends on the mesh so the
+    // result does not depend on the threads count.
+    constexpr size_t SLAB_FACES = 8192;
+    constexpr size_t MAX_SLABS = 256;
+    const double maxError2 = double(maxError) * maxError;
+
+    Init();
+    std::vector<uint32_t> offsets, items;
+    for (size_t iteration = 0; iteration < MAX_ITERATIONS; ++iteration) {
+      if (FacesCount() <= targetFacesCount) {
+        break;
+      }
+      if (iteration > 0) {
+        UpdateRefs();
+      }
+      for (Triangle &t : triangles) {
+        t.dirty = false;
+      }
+      // the allowed error grows with every iteration, so the cheapest edges
+      // are collapsed first.
+      const double threshold = 1e-9 * std::pow(iteration + 3, AGGRESSIVENESS);
+      if (threshold > maxError2) {
+        break;
+      }
+
+      // the slabs collapse their edges in parallel, the edges whose faces
+      // cross a slab bound wait for the next iterations, which move the
+      // bounds. The faces to delete are shared between the slabs by their
+      // faces count.
+      const size_t slabsCount =
+          std::clamp<size_t>(FacesCount() / SLAB_FACES, 1, MAX_SLABS);
+      UpdateSlabs(slabsCount, std::fmod(iteration * 0.618034f, 1.0f));
+      FillRows(
+          triangles.size(), slabsCount,
+          [&](size_t i, const auto &emit) {
+            const uint32_t *v = triangles[i].v;
+            if (slabs[v[0]] == slabs[v[1]] && slabs[v[0]] == slabs[v[2]]) {
+              emit(slabs[v[0]]);
+            }
+          },
+          offsets, items);
+      if (items.empty()) {
+        continue;
+      }
+      const size_t toDelete = FacesCount() - targetFacesCount;
+      slabRefs.assign(slabsCount, std::vector<Ref>());
+      size_t deleted = 0;
+#pragma omp parallel for schedule(dynamic, 1) reduction(+ : deleted)
+      for (int64_t slab = 0; slab < int64_t(slabsCount); ++slab) {
+        const size_t slabFaces = offsets[slab + 1] - offsets[slab];
+        const size_t budget =
+            (toDelete * slabFaces + items.size() - 1) / items.size();
+        deleted += CollapseSlab(slab, items, offsets[slab], offsets[slab + 1],
+                                threshold, budget);
+      }
+      deletedCount += deleted;
+    }
+  }
+
+  Mesh ToMesh(const Mesh &source) const {
+    Mesh result;
+    result.name = source.name;
+    result.color = source.color;
+    result.id = source.id;
+    result.visible = source.visible;
+
+    std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+    for (const Triangle &t : triangles) {
+      if (t.deleted) {
+        continue;
+      }
+      Mesh::Triangle f;
+      for (size_t j = 0; j < 3; ++j) {
+        uint32_t &index = remap[t.v[j]];
+        if (index == UINT32_MAX) {
+          index = result.vertices.size();
+          result.vertices.push_back(vertices[t.v[j]].p);
+        }
+        f[j] = index;
+      }
+      result.faces.push_back(f);
+    }
+    return result;
+  }
+};
+} // namespace
+
+Mesh Decimate(const Mesh &mesh, size_t targetFacesCount, float maxError) {
+  const Mesh welded = WeldVertices(mesh);
+  TIME_BLOCK("Mesh decimation")
+  Decimator decimator(welded);
+  decimator.Run(targetFacesCount, maxError);
+  return decimator.ToMesh(welded);
+}
@@ -184,42 +184,74 @@ Mat4 Perspective(double fovy, double aspect, double zNear, double zFar) {
 }
 
 bool Intersect(const Vec3f planePt, const Vec3f planeN, const Vec3f triA,
-               const Vec3f triB, const Vec3f triC, Segment3D &out)
+               const Vec3f triB, const Vec3f triC, Segment3D &out) {
+  uint8_t startEdge, endEdge;
+  return Intersect(planePt, planeN, triA, triB, triC, out, startEdge, endEdge);
+}
 
-{
+namespace {
+// The signed distances of the points to the plane, and the point alone on its
+// side of it, -1 if the plane doesn't cross the triangle. The points on the
+// plane count as above it, so that the faces around a point agree on the
+// crossed edges and a face touching the plane by an edge gives a segment on
+// one side only. A face only touching the plane at its lone point has no
+// segment either.
+int LonePoint(const Vec3f &planePt, const Vec3f &planeN, const Vec3f p[3],
+              float d[3]) {
   const float planeD = -DotProduct(planePt, planeN);
-  constexpr float eps = 1e-7;
-  const float d1 = DotProduct(planeN, triA) + planeD;
-  const float d2 = DotProduct(planeN, triB) + planeD;
-  const float d3 = DotProduct(planeN, triC) + planeD;
-
-  const bool s1 = d1 * d2 < 0;
-  const bool s2 = d2 * d3 < 0;
-  const bool s3 = d3 * d1 < 0;
+  bool below[3];
+  for (size_t i = 0; i < 3; ++i) {
+    d[i] = DotProduct(planeN, p[i]) + planeD;
+    below[i] = d[i] < 0;
+  }
+  if (below[0] == below[1] && below[1] == below[2]) {
+    return -1;
+  }
+  const int lone = below[0] == below[1] ? 2 : below[1] == below[2] ? 0 : 1;
+  return d[lone] == 0 ? -1 : lone;
+}
+} // namespace
 
-  if (s1 && s2 && s3) {
+bool Intersect(const Vec3f planePt, const Vec3f planeN, const Vec3f triA,
+               const Vec3f triB, const Vec3f triC, Segment3D &out,
+               uint8_t &startEdge, uint8_t &endEdge) {
+  const Vec3f p[3] = {triA, triB, triC};
+  float d[3];
+  const int lone = LonePoint(planePt, planeN, p, d);
+  if (lone < 0) {
     return false;
-  } else if (s1 && s2) {
-    const float t0 = d1 / (d1 - d2);
-    const float t1 = d2 / (d2 - d3);
-    out.start = Lerp(triA, triB, t0);
-    out.end = Lerp(triB, triC, t1);
-    return true;
-  } else if (s2 && s3) {
-    const float t0 = d2 / (d2 - d3);
-    const float t1 = d3 / (d3 - d1);
-    out.start = Lerp(triB, triC, t0);
-    out.end = Lerp(triC, triA, t1);
-    return true;
-  } else if (s3 && s1) {
-    const float t0 = d3 / (d3 - d1);
-    const float t1 = d1 / (d1 - d2);
-    out.start = Lerp(triC, triA, t0);
-    out.end = Lerp(triA, triB, t1);
-    return true;
+  }
+  // the crossing of the edge from point a to point b, exactly a point of the
+  // triangle if it lies on the plane.
+  const auto Cross = [&](size_t a, size_t b, Vec3f &point, uint8_t &edge) {
+    if (d[a] == 0 || d[b] == 0) {
+      const size_t on = d[a] == 0 ? a : b;
+      point = p[on];
+      edge = 3 + on;
+    } else {
+      point = Lerp(p[a], p[b], d[a] / (d[a] - d[b]));
+      edge = a;
+    }
+  };
+  const size_t prev = (lone + 2) % 3;
+  const size_t next = (lone + 1) % 3;
+  // the direction follows from the winding, so that it holds for the segments
+  // too short to have one.
+  if (d[lone] < 0) {
+    Cross(prev, lone, out.start, startEdge);
+    Cross(lone, next, out.end, endEdge);
   } else {
-    return false;
+    Cross(lone, next, out.start, startEdge);
+    Cross(prev, lone, out.end, endEdge);
   }
+  return true;
+}
+
+bool Crosses(const Vec3f planePt, const Vec3f planeN, const Vec3f triA,
+             const Vec3f triB, const Vec3f triC) {
+  const Vec3f p[3] = {triA, triB, triC};
+  float d[3];
+  return LonePoint(planePt, planeN, p, d) >= 0;
 }
 inline float pow2(float x) { return x * x; }
 
@@ -1,7 +1,10 @@
 #include <GL/gl3w.h>
 #include <graphics.h>
+#include <scratch.h>
 
 #include <cassert>
+#include <cmath>
+#include <cstring>
 
 namespace {
 int32_t CompileShader(const char *shader, ShaderType type) {
@@ -30,6 +33,54 @@ int32_t CompileShader(const char *shader, ShaderType type) {
   }
   return id;
 }
+
+// positions are quantised to 16 bits inside the bounding box of the mesh and
+// normals are octahedral encoded on 8 bits per component, 8 bytes per vertex.
+struct PackedVertex {
+  uint16_t position[3];
+  int8_t normal[2];
+};
+static_assert(sizeof(PackedVertex) == 8, "unexpected vertex padding");
+
+// Allocates size bytes for the buffer bound to target and lets fill write
+// them in place through a mapping, so the data isn't staged in a vector and
+// copied again by the driver. Falls back to a copy if the mapping fails.
+template <typename Fill>
+void UploadBuffer(GLenum target, size_t size, const Fill &fill) {
+  glBufferData(target, size, nullptr, GL_STATIC_DRAW);
+  if (size == 0) {
+    return;
+  }
+  if (void *data = glMapBufferRange(target, 0, size,
+                                    GL_MAP_WRITE_BIT |
+                                        GL_MAP_INVALIDATE_BUFFER_BIT)) {
+    fill(data);
+    // the content is undefined if the mapping was lost meanwhile.
+    if (glUnmapBuffer(target) == GL_TRUE) {
+      return;
+    }
+  }
+  struct Staging;
+  std::vector<uint8_t> &data = ScratchVector<Staging, uint8_t>();
+  data.resize(size);
+  fill(data.data());
+  glBufferSubData(target, 0, size, data.data());
+}
+
+// maps a unit vector to the octahedron unfolded on the [-1, 1] square.
+Vec2f OctahedralEncode(const Vec3f &n) {
+  const float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+  if (!(l1 > 0)) {
+    return Vec2f{0, 0};
+  }
+  Vec2f p{n.x / l1, n.y / l1};
+  if (n.z < 0) {
+    const Vec2f folded{(1 - std::abs(p.y)) * (p.x >= 0 ? 1 : -1),
+                       (1 - std::abs(p.x)) * (p.y >= 0 ? 1 : -1)};
+    p = folded;
+  }
+  return p;
+}
 } // namespace
 Mat4 Camera::GetProjectionMatrix(size_t width, size_t height) const {
   const float farClip = farClipRatio * lengthScale;
@@ -53,6 +104,17 @@ void Camera::FitBBox(const BBox &box) {
   farClipRatio = DEFAULT_FAR_CLIP;
 }
 
+Vec3f Camera::GetPosition() const {
+  // the view matrix is a rigid transform, the eye is -R^T * t.
+  Vec3f position = {0};
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      position[i] -= viewMatrix.elements[i][j] * viewMatrix.elements[3][j];
+    }
+  }
+  return position;
+}
+
 void Camera::GetFrame(Vec3f &look, Vec3f &up, Vec3f &right) const {
   Mat3 r = {};
   for (int i = 0; i < 3; i++) {
@@ -194,25 +256,36 @@ void UpdateTexture(uint32_t textureId, size_t width, size_t height,
 }
 
 MeshRenderInfo::MeshRenderInfo(Mesh &mesh) {
-  const std::vector<Vec3f> vertexNormals =
-      CalculateVertexNormals(mesh, BuildConnectivity(mesh));
+  struct Normals;
+  std::vector<Vec3f> &vertexNormals = ScratchVector<Normals, Vec3f>();
+  CalculateVertexNormals(mesh, vertexNormals);
 
   box = CalculateBBox(mesh);
   verticesCount = mesh.vertices.size();
   facesCount = mesh.faces.size();
   id = mesh.id;
 
-  struct VertexInfo {
-    Vec3f position;
-    Vec3f normal;
-  };
-  std::vector<VertexInfo> vertices(verticesCount);
-  for (size_t i = 0; i < verticesCount; i++) {
-    vertices[i].position = mesh.vertices[i];
-    vertices[i].normal = vertexNormals[i];
+  const Vec3f boxSize = box.Size();
+  float scale[3] = {};
+  for (size_t i = 0; i < 3; ++i) {
+    scale[i] = boxSize[i] > 0 ? UINT16_MAX / boxSize[i] : 0;
   }
-
-  const uint32_t *indicies = (const uint32_t *)(mesh.faces.data());
+  const auto PackVertices = [&](void *data) {
+    PackedVertex *vertices = (PackedVertex *)data;
+#pragma omp parallel for
+    for (int64_t i = 0; i < int64_t(verticesCount); i++) {
+      const Vec3f p = mesh.vertices[i] - box.min;
+      for (size_t j = 0; j < 3; ++j) {
+        vertices[i].position[j] = uint16_t(std::lround(p[j] * scale[j]));
+      }
+      const Vec2f n = OctahedralEncode(vertexNormals[i]);
+      vertices[i].normal[0] = int8_t(std::lround(n.x * INT8_MAX));
+      vertices[i].normal[1] = int8_t(std::lround(n.y * INT8_MAX));
+    }
+  };
+  const auto CopyIndices = [&](void *data) {
+    memcpy(data, mesh.faces.data(), facesCount * sizeof(Mesh::Triangle));
+  };
 
   {
     uint32_t bufferId = 0;
@@ -231,20 +304,33 @@ MeshRenderInfo::MeshRenderInfo(Mesh &mesh) {
     elementBufferId = bufferId;
   }
   glBindBuffer(GL_ARRAY_BUFFER, vertexBufferId);
-  glBufferData(GL_ARRAY_BUFFER, verticesCount * sizeof(VertexInfo),
-               vertices.data(), GL_STATIC_DRAW);
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(VertexInfo),
-                        (void *)offsetof(VertexInfo, position));
+  UploadBuffer(GL_ARRAY_BUFFER, verticesCount * sizeof(PackedVertex),
+               PackVertices);
+  glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex),
+                        (void *)offsetof(PackedVertex, position));
   glEnableVertexAttribArray(0);
-  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(VertexInfo),
-                        (void *)offsetof(VertexInfo, normal));
+  glVertexAttribPointer(1, 2, GL_BYTE, GL_TRUE, sizeof(PackedVertex),
+                        (void *)offsetof(PackedVertex, normal));
   glEnableVertexAttribArray(1);
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBufferId);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, facesCount * sizeof(Mesh::Triangle),
-               indicies, GL_STATIC_DRAW);
+  UploadBuffer(GL_ELEMENT_ARRAY_BUFFER, facesCount * sizeof(Mesh::Triangle),
+               CopyIndices);
   glBindVertexArray(0);
 }
 
+void MeshRenderInfo::Release() {
+  if (vertexBufferObject != -1) {
+    const uint32_t vertexArray = vertexBufferObject;
+    glDeleteVertexArrays(1, &vertexArray);
+  }
+  const uint32_t buffers[2] = {uint32_t(vertexBufferId),
+                               uint32_t(elementBufferId)};
+  if (vertexBufferId != -1 && elementBufferId != -1) {
+    glDeleteBuffers(2, buffers);
+  }
+  *this = MeshRenderInfo();
+}
+
 void RenderMesh(const RenderBuffer &buffer, const Program &program,
                 const MeshRenderInfo &info) {
   glBindFramebuffer(GL_FRAMEBUFFER, buffer.frameBufferId);
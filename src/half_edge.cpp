@@ -0,0 +1,133 @@
+#include "half_edge.h"
+
+#include <cstring>
+#include <iterator>
+
+HalfEdgeMesh BuildHalfEdgeMesh(const Mesh &mesh) {
+  TIME_BLOCK("Half-edge mesh")
+  constexpr uint32_t INVALID = HalfEdgeMesh::INVALID;
+  HalfEdgeMesh result;
+  // the faces with a repeated vertex have no area and would make their edges
+  // non-manifold, they are dropped.
+  Mesh valid;
+  const Mesh *source = &mesh;
+  const auto IsDegenerate = [](const Mesh::Triangle &t) {
+    return t[0] == t[1] || t[1] == t[2] || t[2] == t[0];
+  };
+  if (std::any_of(mesh.faces.begin(), mesh.faces.end(), IsDegenerate)) {
+    valid.vertices = mesh.vertices;
+    valid.faces.reserve(mesh.faces.size());
+    std::copy_if(mesh.faces.begin(), mesh.faces.end(),
+                 std::back_inserter(valid.faces),
+                 [&](const Mesh::Triangle &t) { return !IsDegenerate(t); });
+    source = &valid;
+  }
+  const int64_t verticesCount = source->vertices.size();
+  const int64_t halfEdgesCount = 3 * source->faces.size();
+  result.vertices = source->vertices;
+  result.origins.resize(halfEdgesCount);
+  result.twins.resize(halfEdgesCount);
+  result.vertexEdges.resize(verticesCount);
+  static_assert(sizeof(Mesh::Triangle) == 3 * sizeof(uint32_t),
+                "faces must be packed");
+  if (halfEdgesCount > 0) {
+    memcpy(result.origins.data(), source->faces.data(),
+           halfEdgesCount * sizeof(uint32_t));
+  }
+
+  // the twin of a -> b is the only b -> a among the faces around a.
+  const Connectivity connectivity = BuildConnectivity(*source);
+#pragma omp parallel for
+  for (int64_t h = 0; h < halfEdgesCount; ++h) {
+    const uint32_t a = result.Origin(h);
+    const uint32_t b = result.Target(h);
+    uint32_t twin = INVALID;
+    size_t found = 0;
+    for (const uint32_t face : connectivity.pointCells[a]) {
+      for (uint32_t k = 3 * face; k < 3 * face + 3; ++k) {
+        if (result.Origin(k) == b && result.Target(k) == a) {
+          twin = k;
+          found++;
+        }
+      }
+    }
+    // a -> b used by another face as well makes the edge non-manifold.
+    if (found == 1) {
+      for (const uint32_t face : connectivity.pointCells[a]) {
+        for (uint32_t k = 3 * face; k < 3 * face + 3; ++k) {
+          if (k != uint32_t(h) && result.Origin(k) == a &&
+              result.Target(k) == b) {
+            found++;
+          }
+        }
+      }
+    }
+    result.twins[h] = found == 1 ? twin : INVALID;
+  }
+
+  // a border half-edge starts the turn around a border vertex, so that the
+  // turn covers all its faces.
+#pragma omp parallel for
+  for (int64_t v = 0; v < verticesCount; ++v) {
+    uint32_t edge = INVALID;
+    for (const uint32_t face : connectivity.pointCells[v]) {
+      for (uint32_t k = 3 * face; k < 3 * face + 3; ++k) {
+        if (result.Origin(k) == uint32_t(v) &&
+            (edge == INVALID || result.IsBorder(k))) {
+          edge = k;
+        }
+      }
+      if (edge != INVALID && result.IsBorder(edge)) {
+        break;
+      }
+    }
+    result.vertexEdges[v] = edge;
+  }
+  return result;
+}
+
+Mesh ToMesh(const HalfEdgeMesh &mesh) {
+  Mesh result;
+  result.vertices = mesh.vertices;
+  result.faces.resize(mesh.FacesCount());
+  if (!mesh.origins.empty()) {
+    memcpy(result.faces.data(), mesh.origins.data(),
+           mesh.origins.size() * sizeof(uint32_t));
+  }
+  return result;
+}
+
+bool CheckHalfEdgeRoundTrip(const Mesh &mesh) {
+  TIME_BLOCK("Half-edge check")
+  constexpr uint32_t INVALID = HalfEdgeMesh::INVALID;
+  const HalfEdgeMesh halfEdges = BuildHalfEdgeMesh(mesh);
+  const int64_t halfEdgesCount = halfEdges.origins.size();
+  const int64_t verticesCount = halfEdges.vertices.size();
+  size_t errors = 0;
+#pragma omp parallel for reduction(+ : errors)
+  for (int64_t h = 0; h < halfEdgesCount; ++h) {
+    const uint32_t twin = halfEdges.Twin(h);
+    if (twin != INVALID) {
+      errors += twin >= halfEdgesCount || halfEdges.Twin(twin) != h ||
+                halfEdges.Origin(twin) != halfEdges.Target(h) ||
+                halfEdges.Target(twin) != halfEdges.Origin(h);
+    }
+  }
+#pragma omp parallel for reduction(+ : errors)
+  for (int64_t v = 0; v < verticesCount; ++v) {
+    const uint32_t h = halfEdges.vertexEdges[v];
+    errors += h != INVALID && halfEdges.Origin(h) != v;
+  }
+  // back to the faces without a repeated vertex, in the same order.
+  const Mesh back = ToMesh(halfEdges);
+  size_t face = 0;
+  for (const Mesh::Triangle &t : mesh.faces) {
+    if (t[0] == t[1] || t[1] == t[2] || t[2] == t[0]) {
+      continue;
+    }
+    errors += face >= back.faces.size() || back.faces[face] != t;
+    face++;
+  }
+  return errors == 0 && face == back.faces.size() &&
+         back.vertices.size() == mesh.vertices.size();
+}
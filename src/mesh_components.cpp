@@ -0,0 +1,162 @@
+#include "mesh_components.h"
+#include "parallel.h"
+
+#include <atomic>
+#include <memory>
+
+namespace {
+// halves the path on the way up, every vertex pointing to its grandparent.
+// The parents only ever move to lower vertices, so a failed exchange is
+// just a skipped shortcut.
+uint32_t FindRoot(std::atomic<uint32_t> *parents, uint32_t v) {
+  while (true) {
+    uint32_t parent = parents[v].load(std::memory_order_relaxed);
+    const uint32_t grandparent =
+        parents[parent].load(std::memory_order_relaxed);
+    if (parent == grandparent) {
+      return parent;
+    }
+    parents[v].compare_exchange_weak(parent, grandparent,
+                                     std::memory_order_relaxed);
+    v = grandparent;
+  }
+}
+
+// links the higher root below the lower one, so the roots are the lowest
+// vertices whatever the order the threads link in.
+void Union(std::atomic<uint32_t> *parents, uint32_t a, uint32_t b) {
+  while (true) {
+    a = FindRoot(parents, a);
+    b = FindRoot(parents, b);
+    if (a == b) {
+      return;
+    }
+    if (a < b) {
+      std::swap(a, b);
+    }
+    uint32_t expected = a;
+    if (parents[a].compare_exchange_weak(expected, b,
+                                         std::memory_order_relaxed)) {
+      return;
+    }
+  }
+}
+
+struct ComponentSums {
+  size_t facesCount = 0;
+  double volume = 0;
+};
+
+double SignedVolume(const Mesh &mesh, const Mesh::Triangle &t) {
+  const Vec3f &a = mesh.vertices[t[0]];
+  const Vec3f &b = mesh.vertices[t[1]];
+  const Vec3f &c = mesh.vertices[t[2]];
+  return DotProduct(a, CrossProduct(b, c)) / 6.0;
+}
+} // namespace
+
+MeshComponents LabelComponents(const Mesh &mesh) {
+  TIME_BLOCK("Connected components")
+  const int64_t verticesCount = mesh.vertices.size();
+  const int64_t facesCount = mesh.faces.size();
+  MeshComponents result;
+
+  std::unique_ptr<std::atomic<uint32_t>[]> parents(
+      new std::atomic<uint32_t>[verticesCount]);
+#pragma omp parallel for
+  for (int64_t v = 0; v < verticesCount; ++v) {
+    parents[v].store(v, std::memory_order_relaxed);
+  }
+#pragma omp parallel for
+  for (int64_t i = 0; i < facesCount; ++i) {
+    const Mesh::Triangle &t = mesh.faces[i];
+    Union(parents.get(), t[0], t[1]);
+    Union(parents.get(), t[0], t[2]);
+  }
+
+  // the components are numbered in the order of their first face.
+  constexpr uint32_t UNUSED = UINT32_MAX;
+  std::vector<uint32_t> roots(verticesCount);
+#pragma omp parallel for
+  for (int64_t v = 0; v < verticesCount; ++v) {
+    roots[v] = FindRoot(parents.get(), v);
+  }
+  std::vector<uint32_t> labels(verticesCount, UNUSED);
+  result.faceLabels.resize(facesCount);
+  size_t componentsCount = 0;
+  for (int64_t i = 0; i < facesCount; ++i) {
+    uint32_t &label = labels[roots[mesh.faces[i][0]]];
+    if (label == UNUSED) {
+      label = componentsCount++;
+    }
+    result.faceLabels[i] = label;
+  }
+
+  // the components are numbered in the faces order, so the faces range of a
+  // thread sums into a few components next to each other.
+  std::vector<ComponentSums> sums(componentsCount);
+  ParallelScatter(
+      facesCount, sums,
+      [&](size_t i, const auto &emit) { emit(result.faceLabels[i]); },
+      [&](size_t i, const auto &emit) {
+        emit(result.faceLabels[i],
+             ComponentSums{1, SignedVolume(mesh, mesh.faces[i])});
+      },
+      [](ComponentSums &sum, const ComponentSums &s) {
+        sum.facesCount += s.facesCount;
+        sum.volume += s.volume;
+      });
+  result.facesCount.resize(componentsCount);
+  result.volumes.resize(componentsCount);
+  for (size_t c = 0; c < componentsCount; ++c) {
+    result.facesCount[c] = sums[c].facesCount;
+    result.volumes[c] = sums[c].volume;
+  }
+  return result;
+}
+
+size_t RemoveSmallComponents(Mesh &mesh, float minVolume) {
+  const MeshComponents components = LabelComponents(mesh);
+  TIME_BLOCK("Small components removal")
+  std::vector<uint8_t> keep(components.Count());
+  size_t removed = 0;
+  for (size_t c = 0; c < components.Count(); ++c) {
+    keep[c] = std::abs(components.volumes[c]) >= minVolume;
+    removed += !keep[c];
+  }
+  if (removed == 0) {
+    return 0;
+  }
+
+  // the kept faces and the vertices they use stay in the same order.
+  constexpr uint32_t UNUSED = UINT32_MAX;
+  std::vector<uint32_t> remap(mesh.vertices.size(), UNUSED);
+  size_t facesCount = 0;
+  for (size_t i = 0; i < mesh.faces.size(); ++i) {
+    if (keep[components.faceLabels[i]]) {
+      const Mesh::Triangle &t = mesh.faces[i];
+      for (const uint32_t v : t) {
+        remap[v] = 0;
+      }
+      mesh.faces[facesCount++] = t;
+    }
+  }
+  mesh.faces.resize(facesCount);
+  size_t verticesCount = 0;
+  for (size_t v = 0; v < mesh.vertices.size(); ++v) {
+    if (remap[v] != UNUSED) {
+      remap[v] = verticesCount;
+      mesh.vertices[verticesCount++] = mesh.vertices[v];
+    }
+  }
+  mesh.vertices.resize(verticesCount);
+  const int64_t count = facesCount;
+#pragma omp parallel for
+  for (int64_t i = 0; i < count; ++i) {
+    for (uint32_t &v : mesh.faces[i]) {
+      v = remap[v];
+    }
+  }
+  mesh.box = BBox{};
+  return removed;
+}
@@ -0,0 +1,145 @@
+#include "mesh_optimizer.h"
+#include "scratch.h"
+
+#include <cassert>
+
+float CalculateACMR(const Mesh &mesh, size_t cacheSize) {
+  if (mesh.faces.empty()) {
+    return 0;
+  }
+  // time at which every vertex entered the cache.
+  struct Entered;
+  std::vector<size_t> &entered = ScratchVector<Entered, size_t>();
+  entered.assign(mesh.vertices.size(), 0);
+  size_t misses = 0;
+  for (const Mesh::Triangle &t : mesh.faces) {
+    for (const uint32_t v : t) {
+      if (entered[v] == 0 || misses + 1 - entered[v] > cacheSize) {
+        misses++;
+        entered[v] = misses;
+      }
+    }
+  }
+  return float(misses) / mesh.faces.size();
+}
+
+void OptimizeVertexCache(Mesh &mesh, size_t cacheSize) {
+  TIME_BLOCK("Vertex cache optimization")
+  const size_t verticesCount = mesh.vertices.size();
+  const size_t facesCount = mesh.faces.size();
+
+  struct Connections;
+  Connectivity &connectivity = Scratch<Connections, Connectivity>();
+  BuildConnectivity(mesh, connectivity);
+  const Adjacency &adjacency = connectivity.pointCells;
+  struct LiveFaces;
+  std::vector<uint32_t> &liveFaces = ScratchVector<LiveFaces, uint32_t>();
+  liveFaces.resize(verticesCount);
+  for (size_t i = 0; i < verticesCount; ++i) {
+    liveFaces[i] = adjacency[i].size();
+  }
+  struct CacheTime;
+  std::vector<size_t> &cacheTime = ScratchVector<CacheTime, size_t>();
+  cacheTime.assign(verticesCount, 0);
+  struct Emitted;
+  std::vector<uint8_t> &emitted = ScratchVector<Emitted, uint8_t>();
+  emitted.assign(facesCount, false);
+  struct DeadEnds;
+  std::vector<uint32_t> &deadEnds = ScratchVector<DeadEnds, uint32_t>();
+  deadEnds.clear();
+  struct Candidates;
+  std::vector<uint32_t> &candidates = ScratchVector<Candidates, uint32_t>();
+  // the previous faces are freed with this buffer, not kept as scratch.
+  std::vector<Mesh::Triangle> faces;
+  faces.reserve(facesCount);
+
+  size_t time = cacheSize + 1;
+  size_t cursor = 0;
+  // a vertex with faces left, taken from the recent vertices if possible.
+  auto SkipDeadEnd = [&]() -> int64_t {
+    while (!deadEnds.empty()) {
+      const uint32_t v = deadEnds.back();
+      deadEnds.pop_back();
+      if (liveFaces[v] > 0) {
+        return v;
+      }
+    }
+    for (; cursor < verticesCount; ++cursor) {
+      if (liveFaces[cursor] > 0) {
+        return cursor;
+      }
+    }
+    return -1;
+  };
+
+  int64_t fan = SkipDeadEnd();
+  while (fan >= 0) {
+    candidates.clear();
+    for (const uint32_t f : adjacency[fan]) {
+      if (emitted[f]) {
+        continue;
+      }
+      emitted[f] = true;
+      const Mesh::Triangle &t = mesh.faces[f];
+      faces.push_back(t);
+      for (size_t j = 0; j < 3; ++j) {
+        const uint32_t v = t[j];
+        // a degenerate face counts once for its repeated vertex.
+        if ((j > 0 && v == t[0]) || (j == 2 && v == t[1])) {
+          continue;
+        }
+        deadEnds.push_back(v);
+        candidates.push_back(v);
+        liveFaces[v]--;
+        if (time - cacheTime[v] > cacheSize) {
+          cacheTime[v] = time++;
+        }
+      }
+    }
+
+    // the next fan is the candidate that stays longest in the cache after
+    // emitting its remaining faces.
+    int64_t next = -1;
+    int64_t best = -1;
+    for (const uint32_t v : candidates) {
+      if (liveFaces[v] == 0) {
+        continue;
+      }
+      int64_t priority = 0;
+      if (time - cacheTime[v] + 2 * liveFaces[v] <= cacheSize) {
+        priority = time - cacheTime[v];
+      }
+      if (priority > best) {
+        best = priority;
+        next = v;
+      }
+    }
+    fan = next >= 0 ? next : SkipDeadEnd();
+  }
+  assert(faces.size() == facesCount);
+  mesh.faces.swap(faces);
+}
+
+void OptimizeVertexFetch(Mesh &mesh) {
+  TIME_BLOCK("Vertex fetch optimization")
+  constexpr uint32_t UNUSED = UINT32_MAX;
+  const size_t verticesCount = mesh.vertices.size();
+  struct Remap;
+  std::vector<uint32_t> &remap = ScratchVector<Remap, uint32_t>();
+  remap.assign(verticesCount, UNUSED);
+  std::vector<Vec3f> vertices;
+  vertices.reserve(verticesCount);
+  for (Mesh::Triangle &t : mesh.faces) {
+    for (uint32_t &v : t) {
+      if (remap[v] == UNUSED) {
+        remap[v] = vertices.size();
+        vertices.push_back(mesh.vertices[v]);
+      }
+      v = remap[v];
+    }
+  }
+  if (vertices.size() != mesh.vertices.size()) {
+    mesh.box = BBox{};
+  }
+  mesh.vertices.swap(vertices);
+}
@@ -0,0 +1,243 @@
+#include "mesh_statistics.h"
+
+#include <omp.h>
+
+#include <array>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define USE_SSE2
+#endif
+
+namespace {
+static_assert(sizeof(Vec3f) == 3 * sizeof(float), "Vec3f must be packed");
+
+// arrays smaller than this are reduced by a single thread.
+constexpr size_t PARALLEL_COUNT = 1 << 16;
+
+// Reduces a range of the vertices per thread with reduce(first, last), then
+// merges the results in the threads order so that they don't depend on the
+// scheduling.
+template <typename T, typename Reduce, typename Merge>
+T ParallelReduce(size_t count, const T &init, const Reduce &reduce,
+                 const Merge &merge) {
+  const int threads = count < PARALLEL_COUNT ? 1 : omp_get_max_threads();
+  std::vector<T> partial(threads, init);
+#pragma omp parallel num_threads(threads)
+  {
+    const size_t thread = omp_get_thread_num();
+    const size_t threadsCount = omp_get_num_threads();
+    partial[thread] = reduce(count * thread / threadsCount,
+                             count * (thread + 1) / threadsCount);
+  }
+  T result = init;
+  for (const T &p : partial) {
+    result = merge(result, p);
+  }
+  return result;
+}
+
+BBox BBoxRange(const Vec3f *vertices, size_t count) {
+  BBox result;
+  size_t i = 0;
+#ifdef USE_SSE2
+  // 4 vertices are 3 registers: x y z x | y z x y | z x y z.
+  if (count >= 4) {
+    const float *data = vertices->data;
+    __m128 minA = _mm_loadu_ps(data);
+    __m128 minB = _mm_loadu_ps(data + 4);
+    __m128 minC = _mm_loadu_ps(data + 8);
+    __m128 maxA = minA, maxB = minB, maxC = minC;
+    for (i = 4; i + 4 <= count; i += 4) {
+      const float *p = vertices[i].data;
+      const __m128 a = _mm_loadu_ps(p);
+      const __m128 b = _mm_loadu_ps(p + 4);
+      const __m128 c = _mm_loadu_ps(p + 8);
+      minA = _mm_min_ps(minA, a);
+      minB = _mm_min_ps(minB, b);
+      minC = _mm_min_ps(minC, c);
+      maxA = _mm_max_ps(maxA, a);
+      maxB = _mm_max_ps(maxB, b);
+      maxC = _mm_max_ps(maxC, c);
+    }
+    float min[12], max[12];
+    _mm_storeu_ps(min, minA);
+    _mm_storeu_ps(min + 4, minB);
+    _mm_storeu_ps(min + 8, minC);
+    _mm_storeu_ps(max, maxA);
+    _mm_storeu_ps(max + 4, maxB);
+    _mm_storeu_ps(max + 8, maxC);
+    for (size_t k = 0; k < 12; ++k) {
+      result.min[k % 3] = (std::min)(result.min[k % 3], min[k]);
+      result.max[k % 3] = (std::max)(result.max[k % 3], max[k]);
+    }
+  }
+#endif
+  for (; i < count; ++i) {
+    result.Merge(vertices[i]);
+  }
+  return result;
+}
+
+using Sum3 = std::array<double, 3>;
+
+Sum3 SumRange(const Vec3f *vertices, size_t count) {
+  Sum3 result = {0, 0, 0};
+  size_t i = 0;
+#ifdef USE_SSE2
+  // the float sums are flushed to the double ones every few vertices.
+  constexpr size_t FLUSH_COUNT = 256;
+  while (i + 4 <= count) {
+    __m128 sumA = _mm_setzero_ps();
+    __m128 sumB = _mm_setzero_ps();
+    __m128 sumC = _mm_setzero_ps();
+    const size_t last = (std::min)(count, i + FLUSH_COUNT);
+    for (; i + 4 <= last; i += 4) {
+      const float *p = vertices[i].data;
+      sumA = _mm_add_ps(sumA, _mm_loadu_ps(p));
+      sumB = _mm_add_ps(sumB, _mm_loadu_ps(p + 4));
+      sumC = _mm_add_ps(sumC, _mm_loadu_ps(p + 8));
+    }
+    float sum[12];
+    _mm_storeu_ps(sum, sumA);
+    _mm_storeu_ps(sum + 4, sumB);
+    _mm_storeu_ps(sum + 8, sumC);
+    for (size_t k = 0; k < 12; ++k) {
+      result[k % 3] += sum[k];
+    }
+  }
+#endif
+  for (; i < count; ++i) {
+    for (size_t j = 0; j < 3; ++j) {
+      result[j] += vertices[i].data[j];
+    }
+  }
+  return result;
+}
+
+// xx, xy, xz, yy, yz, zz
+using Sum6 = std::array<double, 6>;
+
+// the sums of the products of the coordinates around c.
+Sum6 CovarianceRange(const Vec3f *vertices, size_t count, const Vec3f &c) {
+  Sum6 result = {};
+  size_t i = 0;
+  // the float sums are flushed to the double ones every few vertices.
+  constexpr size_t FLUSH_COUNT = 256;
+#ifdef USE_SSE2
+  const __m128 cx = _mm_set1_ps(c.x);
+  const __m128 cy = _mm_set1_ps(c.y);
+  const __m128 cz = _mm_set1_ps(c.z);
+  while (i + 4 <= count) {
+    __m128 sums[6] = {_mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(),
+                      _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps()};
+    const size_t last = (std::min)(count, i + FLUSH_COUNT);
+    for (; i + 4 <= last; i += 4) {
+      // x y z x | y z x y | z x y z to x x x x, y y y y and z z z z.
+      const float *p = vertices[i].data;
+      const __m128 a = _mm_loadu_ps(p);
+      const __m128 b = _mm_loadu_ps(p + 4);
+      const __m128 d = _mm_loadu_ps(p + 8);
+      const __m128 bd = _mm_shuffle_ps(b, d, _MM_SHUFFLE(1, 1, 2, 2));
+      const __m128 ab0 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1));
+      const __m128 bd1 = _mm_shuffle_ps(b, d, _MM_SHUFFLE(2, 2, 3, 3));
+      const __m128 ab1 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2));
+      const __m128 x =
+          _mm_sub_ps(_mm_shuffle_ps(a, bd, _MM_SHUFFLE(2, 0, 3, 0)), cx);
+      const __m128 y =
+          _mm_sub_ps(_mm_shuffle_ps(ab0, bd1, _MM_SHUFFLE(2, 0, 2, 0)), cy);
+      const __m128 z =
+          _mm_sub_ps(_mm_shuffle_ps(ab1, d, _MM_SHUFFLE(3, 0, 2, 0)), cz);
+      sums[0] = _mm_add_ps(sums[0], _mm_mul_ps(x, x));
+      sums[1] = _mm_add_ps(sums[1], _mm_mul_ps(x, y));
+      sums[2] = _mm_add_ps(sums[2], _mm_mul_ps(x, z));
+      sums[3] = _mm_add_ps(sums[3], _mm_mul_ps(y, y));
+      sums[4] = _mm_add_ps(sums[4], _mm_mul_ps(y, z));
+      sums[5] = _mm_add_ps(sums[5], _mm_mul_ps(z, z));
+    }
+    for (size_t k = 0; k < 6; ++k) {
+      float sum[4];
+      _mm_storeu_ps(sum, sums[k]);
+      result[k] += double(sum[0]) + sum[1] + sum[2] + sum[3];
+    }
+  }
+#endif
+  while (i < count) {
+    const size_t last = (std::min)(count, i + FLUSH_COUNT);
+    float xx = 0, xy = 0, xz = 0, yy = 0, yz = 0, zz = 0;
+    for (; i < last; ++i) {
+      const float x = vertices[i].x - c.x;
+      const float y = vertices[i].y - c.y;
+      const float z = vertices[i].z - c.z;
+      xx += x * x;
+      xy += x * y;
+      xz += x * z;
+      yy += y * y;
+      yz += y * z;
+      zz += z * z;
+    }
+    const float partial[6] = {xx, xy, xz, yy, yz, zz};
+    for (size_t k = 0; k < 6; ++k) {
+      result[k] += partial[k];
+    }
+  }
+  return result;
+}
+} // namespace
+
+BBox CalculateBBox(const Vec3f *vertices, size_t count) {
+  return ParallelReduce(
+      count, BBox{},
+      [&](size_t first, size_t last) {
+        return BBoxRange(vertices + first, last - first);
+      },
+      [](BBox a, const BBox &b) {
+        if (b.IsValid()) {
+          a.Merge(b);
+        }
+        return a;
+      });
+}
+
+Vec3f CalculateCentroid(const Vec3f *vertices, size_t count) {
+  if (count == 0) {
+    return Vec3f{0, 0, 0};
+  }
+  const Sum3 sum = ParallelReduce(
+      count, Sum3{0, 0, 0},
+      [&](size_t first, size_t last) {
+        return SumRange(vertices + first, last - first);
+      },
+      [](const Sum3 &a, const Sum3 &b) {
+        return Sum3{a[0] + b[0], a[1] + b[1], a[2] + b[2]};
+      });
+  return Vec3f{float(sum[0] / count), float(sum[1] / count),
+               float(sum[2] / count)};
+}
+
+Mat3 CalculateCovariance(const Vec3f *vertices, size_t count) {
+  Mat3 result = {};
+  if (count == 0) {
+    return result;
+  }
+  const Vec3f c = CalculateCentroid(vertices, count);
+  const Sum6 sum = ParallelReduce(
+      count, Sum6{},
+      [&](size_t first, size_t last) {
+        return CovarianceRange(vertices + first, last - first, c);
+      },
+      [](Sum6 a, const Sum6 &b) {
+        for (size_t k = 0; k < 6; ++k) {
+          a[k] += b[k];
+        }
+        return a;
+      });
+  const size_t index[3][3] = {{0, 1, 2}, {1, 3, 4}, {2, 4, 5}};
+  for (size_t i = 0; i < 3; ++i) {
+    for (size_t j = 0; j < 3; ++j) {
+      result.elements[i][j] = float(sum[index[i][j]] / count);
+    }
+  }
+  return result;
+}
@@ -0,0 +1,118 @@
+#include "mesh_validation.h"
+#include "scratch.h"
+
+#include <algorithm>
+
+namespace {
+bool HasRepeatedVertex(const Mesh::Triangle &t) {
+  return t[0] == t[1] || t[1] == t[2] || t[2] == t[0];
+}
+
+uint32_t Find(std::vector<uint32_t> &parents, uint32_t i) {
+  while (parents[i] != i) {
+    parents[i] = parents[parents[i]];
+    i = parents[i];
+  }
+  return i;
+}
+} // namespace
+
+MeshValidation ValidateMesh(const Mesh &mesh) {
+  TIME_BLOCK("Mesh validation")
+  MeshValidation result;
+  const int64_t verticesCount = mesh.vertices.size();
+  const int64_t facesCount = mesh.faces.size();
+
+  size_t degenerateFaces = 0;
+#pragma omp parallel for reduction(+ : degenerateFaces)
+  for (int64_t i = 0; i < facesCount; ++i) {
+    const Mesh::Triangle &t = mesh.faces[i];
+    if (HasRepeatedVertex(t)) {
+      degenerateFaces++;
+      continue;
+    }
+    const Vec3f &a = mesh.vertices[t[0]];
+    const Vec3f n =
+        CrossProduct(mesh.vertices[t[1]] - a, mesh.vertices[t[2]] - a);
+    degenerateFaces += Length2(n) == 0;
+  }
+  result.degenerateFaces = degenerateFaces;
+
+  // every edge is checked by its lowest vertex, which counts the faces going
+  // along the edge in both directions at the slot of the other vertex in its
+  // neighbours row. The faces with a repeated vertex have no edges.
+  const Connectivity connectivity = BuildConnectivity(mesh, true);
+  const Adjacency &cells = connectivity.pointCells;
+  const Adjacency &neighbours = connectivity.pointNeighbours;
+  size_t edgesCount = 0, boundaryEdges = 0, nonManifoldEdges = 0,
+         flippedEdges = 0, nonManifoldVertices = 0;
+#pragma omp parallel reduction(+ : edgesCount, boundaryEdges,                  \
+                               nonManifoldEdges, flippedEdges,                 \
+                               nonManifoldVertices)
+  {
+    struct Outgoing;
+    struct Incoming;
+    struct Parents;
+    std::vector<uint32_t> &outgoing = ScratchVector<Outgoing, uint32_t>();
+    std::vector<uint32_t> &incoming = ScratchVector<Incoming, uint32_t>();
+    std::vector<uint32_t> &parents = ScratchVector<Parents, uint32_t>();
+#pragma omp for schedule(dynamic, 1024)
+    for (int64_t v = 0; v < verticesCount; ++v) {
+      const Adjacency::Row row = neighbours[v];
+      const auto Slot = [&](uint32_t u) {
+        return uint32_t(std::lower_bound(row.begin(), row.end(), u) -
+                        row.begin());
+      };
+      outgoing.assign(row.size(), 0);
+      incoming.assign(row.size(), 0);
+      parents.resize(row.size());
+      for (size_t i = 0; i < parents.size(); ++i) {
+        parents[i] = i;
+      }
+      // the faces around a manifold vertex are joined by their edges into a
+      // single fan: the edges opposite to the vertex make one component.
+      size_t components = 0;
+      for (const uint32_t f : cells[v]) {
+        const Mesh::Triangle &t = mesh.faces[f];
+        if (HasRepeatedVertex(t)) {
+          continue;
+        }
+        const size_t j = t[0] == v ? 0 : t[1] == v ? 1 : 2;
+        const uint32_t next = Slot(t[(j + 1) % 3]);
+        const uint32_t prev = Slot(t[(j + 2) % 3]);
+        components += outgoing[next] + incoming[next] == 0;
+        outgoing[next]++;
+        components += outgoing[prev] + incoming[prev] == 0;
+        incoming[prev]++;
+        const uint32_t a = Find(parents, next);
+        const uint32_t b = Find(parents, prev);
+        if (a != b) {
+          parents[a] = b;
+          components--;
+        }
+      }
+      nonManifoldVertices += components > 1;
+
+      for (size_t i = 0; i < row.size(); ++i) {
+        const uint32_t faces = outgoing[i] + incoming[i];
+        if (row.begin()[i] < v || faces == 0) {
+          continue;
+        }
+        edgesCount++;
+        if (faces == 1) {
+          boundaryEdges++;
+        } else if (faces > 2) {
+          nonManifoldEdges++;
+        } else if (outgoing[i] != 1) {
+          flippedEdges++;
+        }
+      }
+    }
+  }
+  result.edgesCount = edgesCount;
+  result.boundaryEdges = boundaryEdges;
+  result.nonManifoldEdges = nonManifoldEdges;
+  result.flippedEdges = flippedEdges;
+  result.nonManifoldVertices = nonManifoldVertices;
+  return result;
+}
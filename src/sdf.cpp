@@ -2,56 +2,1517 @@
 
 #include <omp.h>
 
+#include "mesh_statistics.h"
+#include "parallel.h"
+#include "scratch.h"
+
+#include <atomic>
 #include <cassert>
-#include <unordered_map>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define USE_SSE2
+#endif
 
 namespace {
+// the chunks get their ids from several threads at once, 0 is left for the
+// meshes without id.
 static size_t GenerateID() {
-  static size_t id = 0;
-  return id++;
+  static std::atomic<size_t> id = 1;
+  return id.fetch_add(1);
+}
+
+constexpr int16_t edgeTable[256] = {
+    0x0,   0x109, 0x203, 0x30a, 0x406, 0x50f, 0x605, 0x70c, 0x80c, 0x905,
+    0xa0f, 0xb06, 0xc0a, 0xd03, 0xe09, 0xf00, 0x190, 0x99,  0x393, 0x29a,
+    0x596, 0x49f, 0x795, 0x69c, 0x99c, 0x895, 0xb9f, 0xa96, 0xd9a, 0xc93,
+    0xf99, 0xe90, 0x230, 0x339, 0x33,  0x13a, 0x636, 0x73f, 0x435, 0x53c,
+    0xa3c, 0xb35, 0x83f, 0x936, 0xe3a, 0xf33, 0xc39, 0xd30, 0x3a0, 0x2a9,
+    0x1a3, 0xaa,  0x7a6, 0x6af, 0x5a5, 0x4ac, 0xbac, 0xaa5, 0x9af, 0x8a6,
+    0xfaa, 0xea3, 0xda9, 0xca0, 0x460, 0x569, 0x663, 0x76a, 0x66,  0x16f,
+    0x265, 0x36c, 0xc6c, 0xd65, 0xe6f, 0xf66, 0x86a, 0x963, 0xa69, 0xb60,
+    0x5f0, 0x4f9, 0x7f3, 0x6fa, 0x1f6, 0xff,  0x3f5, 0x2fc, 0xdfc, 0xcf5,
+    0xfff, 0xef6, 0x9fa, 0x8f3, 0xbf9, 0xaf0, 0x650, 0x759, 0x453, 0x55a,
+    0x256, 0x35f, 0x55,  0x15c, 0xe5c, 0xf55, 0xc5f, 0xd56, 0xa5a, 0xb53,
+    0x859, 0x950, 0x7c0, 0x6c9, 0x5c3, 0x4ca, 0x3c6, 0x2cf, 0x1c5, 0xcc,
+    0xfcc, 0xec5, 0xdcf, 0xcc6, 0xbca, 0xac3, 0x9c9, 0x8c0, 0x8c0, 0x9c9,
+    0xac3, 0xbca, 0xcc6, 0xdcf, 0xec5, 0xfcc, 0xcc,  0x1c5, 0x2cf, 0x3c6,
+    0x4ca, 0x5c3, 0x6c9, 0x7c0, 0x950, 0x859, 0xb53, 0xa5a, 0xd56, 0xc5f,
+    0xf55, 0xe5c, 0x15c, 0x55,  0x35f, 0x256, 0x55a, 0x453, 0x759, 0x650,
+    0xaf0, 0xbf9, 0x8f3, 0x9fa, 0xef6, 0xfff, 0xcf5, 0xdfc, 0x2fc, 0x3f5,
+    0xff,  0x1f6, 0x6fa, 0x7f3, 0x4f9, 0x5f0, 0xb60, 0xa69, 0x963, 0x86a,
+    0xf66, 0xe6f, 0xd65, 0xc6c, 0x36c, 0x265, 0x16f, 0x66,  0x76a, 0x663,
+    0x569, 0x460, 0xca0, 0xda9, 0xea3, 0xfaa, 0x8a6, 0x9af, 0xaa5, 0xbac,
+    0x4ac, 0x5a5, 0x6af, 0x7a6, 0xaa,  0x1a3, 0x2a9, 0x3a0, 0xd30, 0xc39,
+    0xf33, 0xe3a, 0x936, 0x83f, 0xb35, 0xa3c, 0x53c, 0x435, 0x73f, 0x636,
+    0x13a, 0x33,  0x339, 0x230, 0xe90, 0xf99, 0xc93, 0xd9a, 0xa96, 0xb9f,
+    0x895, 0x99c, 0x69c, 0x795, 0x49f, 0x596, 0x29a, 0x393, 0x99,  0x190,
+    0xf00, 0xe09, 0xd03, 0xc0a, 0xb06, 0xa0f, 0x905, 0x80c, 0x70c, 0x605,
+    0x50f, 0x406, 0x30a, 0x203, 0x109, 0x0};
+constexpr int8_t triTable[256][16] = {
+    {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 8, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 1, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {1, 8, 3, 9, 8, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {1, 2, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 8, 3, 1, 2, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {9, 2, 10, 0, 2, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {2, 8, 3, 2, 10, 8, 10, 9, 8, -1, -1, -1, -1, -1, -1, -1},
+    {3, 11, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 11, 2, 8, 11, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {1, 9, 0, 2, 3, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {1, 11, 2, 1, 9, 11, 9, 8, 11, -1, -1, -1, -1, -1, -1, -1},
+    {3, 10, 1, 11, 10, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 10, 1, 0, 8, 10, 8, 11, 10, -1, -1, -1, -1, -1, -1, -1},
+    {3, 9, 0, 3, 11, 9, 11, 10, 9, -1, -1, -1, -1, -1, -1, -1},
+    {9, 8, 10, 10, 8, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {4, 7, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {4, 3, 0, 7, 3, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 1, 9, 8, 4, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {4, 1, 9, 4, 7, 1, 7, 3, 1, -1, -1, -1, -1, -1, -1, -1},
+    {1, 2, 10, 8, 4, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {3, 4, 7, 3, 0, 4, 1, 2, 10, -1, -1, -1, -1, -1, -1, -1},
+    {9, 2, 10, 9, 0, 2, 8, 4, 7, -1, -1, -1, -1, -1, -1, -1},
+    {2, 10, 9, 2, 9, 7, 2, 7, 3, 7, 9, 4, -1, -1, -1, -1},
+    {8, 4, 7, 3, 11, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {11, 4, 7, 11, 2, 4, 2, 0, 4, -1, -1, -1, -1, -1, -1, -1},
+    {9, 0, 1, 8, 4, 7, 2, 3, 11, -1, -1, -1, -1, -1, -1, -1},
+    {4, 7, 11, 9, 4, 11, 9, 11, 2, 9, 2, 1, -1, -1, -1, -1},
+    {3, 10, 1, 3, 11, 10, 7, 8, 4, -1, -1, -1, -1, -1, -1, -1},
+    {1, 11, 10, 1, 4, 11, 1, 0, 4, 7, 11, 4, -1, -1, -1, -1},
+    {4, 7, 8, 9, 0, 11, 9, 11, 10, 11, 0, 3, -1, -1, -1, -1},
+    {4, 7, 11, 4, 11, 9, 9, 11, 10, -1, -1, -1, -1, -1, -1, -1},
+    {9, 5, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {9, 5, 4, 0, 8, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 5, 4, 1, 5, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {8, 5, 4, 8, 3, 5, 3, 1, 5, -1, -1, -1, -1, -1, -1, -1},
+    {1, 2, 10, 9, 5, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {3, 0, 8, 1, 2, 10, 4, 9, 5, -1, -1, -1, -1, -1, -1, -1},
+    {5, 2, 10, 5, 4, 2, 4, 0, 2, -1, -1, -1, -1, -1, -1, -1},
+    {2, 10, 5, 3, 2, 5, 3, 5, 4, 3, 4, 8, -1, -1, -1, -1},
+    {9, 5, 4, 2, 3, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 11, 2, 0, 8, 11, 4, 9, 5, -1, -1, -1, -1, -1, -1, -1},
+    {0, 5, 4, 0, 1, 5, 2, 3, 11, -1, -1, -1, -1, -1, -1, -1},
+    {2, 1, 5, 2, 5, 8, 2, 8, 11, 4, 8, 5, -1, -1, -1, -1},
+    {10, 3, 11, 10, 1, 3, 9, 5, 4, -1, -1, -1, -1, -1, -1, -1},
+    {4, 9, 5, 0, 8, 1, 8, 10, 1, 8, 11, 10, -1, -1, -1, -1},
+    {5, 4, 0, 5, 0, 11, 5, 11, 10, 11, 0, 3, -1, -1, -1, -1},
+    {5, 4, 8, 5, 8, 10, 10, 8, 11, -1, -1, -1, -1, -1, -1, -1},
+    {9, 7, 8, 5, 7, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {9, 3, 0, 9, 5, 3, 5, 7, 3, -1, -1, -1, -1, -1, -1, -1},
+    {0, 7, 8, 0, 1, 7, 1, 5, 7, -1, -1, -1, -1, -1, -1, -1},
+    {1, 5, 3, 3, 5, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {9, 7, 8, 9, 5, 7, 10, 1, 2, -1, -1, -1, -1, -1, -1, -1},
+    {10, 1, 2, 9, 5, 0, 5, 3, 0, 5, 7, 3, -1, -1, -1, -1},
+    {8, 0, 2, 8, 2, 5, 8, 5, 7, 10, 5, 2, -1, -1, -1, -1},
+    {2, 10, 5, 2, 5, 3, 3, 5, 7, -1, -1, -1, -1, -1, -1, -1},
+    {7, 9, 5, 7, 8, 9, 3, 11, 2, -1, -1, -1, -1, -1, -1, -1},
+    {9, 5, 7, 9, 7, 2, 9, 2, 0, 2, 7, 11, -1, -1, -1, -1},
+    {2, 3, 11, 0, 1, 8, 1, 7, 8, 1, 5, 7, -1, -1, -1, -1},
+    {11, 2, 1, 11, 1, 7, 7, 1, 5, -1, -1, -1, -1, -1, -1, -1},
+    {9, 5, 8, 8, 5, 7, 10, 1, 3, 10, 3, 11, -1, -1, -1, -1},
+    {5, 7, 0, 5, 0, 9, 7, 11, 0, 1, 0, 10, 11, 10, 0, -1},
+    {11, 10, 0, 11, 0, 3, 10, 5, 0, 8, 0, 7, 5, 7, 0, -1},
+    {11, 10, 5, 7, 11, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {10, 6, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 8, 3, 5, 10, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {9, 0, 1, 5, 10, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {1, 8, 3, 1, 9, 8, 5, 10, 6, -1, -1, -1, -1, -1, -1, -1},
+    {1, 6, 5, 2, 6, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {1, 6, 5, 1, 2, 6, 3, 0, 8, -1, -1, -1, -1, -1, -1, -1},
+    {9, 6, 5, 9, 0, 6, 0, 2, 6, -1, -1, -1, -1, -1, -1, -1},
+    {5, 9, 8, 5, 8, 2, 5, 2, 6, 3, 2, 8, -1, -1, -1, -1},
+    {2, 3, 11, 10, 6, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {11, 0, 8, 11, 2, 0, 10, 6, 5, -1, -1, -1, -1, -1, -1, -1},
+    {0, 1, 9, 2, 3, 11, 5, 10, 6, -1, -1, -1, -1, -1, -1, -1},
+    {5, 10, 6, 1, 9, 2, 9, 11, 2, 9, 8, 11, -1, -1, -1, -1},
+    {6, 3, 11, 6, 5, 3, 5, 1, 3, -1, -1, -1, -1, -1, -1, -1},
+    {0, 8, 11, 0, 11, 5, 0, 5, 1, 5, 11, 6, -1, -1, -1, -1},
+    {3, 11, 6, 0, 3, 6, 0, 6, 5, 0, 5, 9, -1, -1, -1, -1},
+    {6, 5, 9, 6, 9, 11, 11, 9, 8, -1, -1, -1, -1, -1, -1, -1},
+    {5, 10, 6, 4, 7, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {4, 3, 0, 4, 7, 3, 6, 5, 10, -1, -1, -1, -1, -1, -1, -1},
+    {1, 9, 0, 5, 10, 6, 8, 4, 7, -1, -1, -1, -1, -1, -1, -1},
+    {10, 6, 5, 1, 9, 7, 1, 7, 3, 7, 9, 4, -1, -1, -1, -1},
+    {6, 1, 2, 6, 5, 1, 4, 7, 8, -1, -1, -1, -1, -1, -1, -1},
+    {1, 2, 5, 5, 2, 6, 3, 0, 4, 3, 4, 7, -1, -1, -1, -1},
+    {8, 4, 7, 9, 0, 5, 0, 6, 5, 0, 2, 6, -1, -1, -1, -1},
+    {7, 3, 9, 7, 9, 4, 3, 2, 9, 5, 9, 6, 2, 6, 9, -1},
+    {3, 11, 2, 7, 8, 4, 10, 6, 5, -1, -1, -1, -1, -1, -1, -1},
+    {5, 10, 6, 4, 7, 2, 4, 2, 0, 2, 7, 11, -1, -1, -1, -1},
+    {0, 1, 9, 4, 7, 8, 2, 3, 11, 5, 10, 6, -1, -1, -1, -1},
+    {9, 2, 1, 9, 11, 2, 9, 4, 11, 7, 11, 4, 5, 10, 6, -1},
+    {8, 4, 7, 3, 11, 5, 3, 5, 1, 5, 11, 6, -1, -1, -1, -1},
+    {5, 1, 11, 5, 11, 6, 1, 0, 11, 7, 11, 4, 0, 4, 11, -1},
+    {0, 5, 9, 0, 6, 5, 0, 3, 6, 11, 6, 3, 8, 4, 7, -1},
+    {6, 5, 9, 6, 9, 11, 4, 7, 9, 7, 11, 9, -1, -1, -1, -1},
+    {10, 4, 9, 6, 4, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {4, 10, 6, 4, 9, 10, 0, 8, 3, -1, -1, -1, -1, -1, -1, -1},
+    {10, 0, 1, 10, 6, 0, 6, 4, 0, -1, -1, -1, -1, -1, -1, -1},
+    {8, 3, 1, 8, 1, 6, 8, 6, 4, 6, 1, 10, -1, -1, -1, -1},
+    {1, 4, 9, 1, 2, 4, 2, 6, 4, -1, -1, -1, -1, -1, -1, -1},
+    {3, 0, 8, 1, 2, 9, 2, 4, 9, 2, 6, 4, -1, -1, -1, -1},
+    {0, 2, 4, 4, 2, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {8, 3, 2, 8, 2, 4, 4, 2, 6, -1, -1, -1, -1, -1, -1, -1},
+    {10, 4, 9, 10, 6, 4, 11, 2, 3, -1, -1, -1, -1, -1, -1, -1},
+    {0, 8, 2, 2, 8, 11, 4, 9, 10, 4, 10, 6, -1, -1, -1, -1},
+    {3, 11, 2, 0, 1, 6, 0, 6, 4, 6, 1, 10, -1, -1, -1, -1},
+    {6, 4, 1, 6, 1, 10, 4, 8, 1, 2, 1, 11, 8, 11, 1, -1},
+    {9, 6, 4, 9, 3, 6, 9, 1, 3, 11, 6, 3, -1, -1, -1, -1},
+    {8, 11, 1, 8, 1, 0, 11, 6, 1, 9, 1, 4, 6, 4, 1, -1},
+    {3, 11, 6, 3, 6, 0, 0, 6, 4, -1, -1, -1, -1, -1, -1, -1},
+    {6, 4, 8, 11, 6, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {7, 10, 6, 7, 8, 10, 8, 9, 10, -1, -1, -1, -1, -1, -1, -1},
+    {0, 7, 3, 0, 10, 7, 0, 9, 10, 6, 7, 10, -1, -1, -1, -1},
+    {10, 6, 7, 1, 10, 7, 1, 7, 8, 1, 8, 0, -1, -1, -1, -1},
+    {10, 6, 7, 10, 7, 1, 1, 7, 3, -1, -1, -1, -1, -1, -1, -1},
+    {1, 2, 6, 1, 6, 8, 1, 8, 9, 8, 6, 7, -1, -1, -1, -1},
+    {2, 6, 9, 2, 9, 1, 6, 7, 9, 0, 9, 3, 7, 3, 9, -1},
+    {7, 8, 0, 7, 0, 6, 6, 0, 2, -1, -1, -1, -1, -1, -1, -1},
+    {7, 3, 2, 6, 7, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {2, 3, 11, 10, 6, 8, 10, 8, 9, 8, 6, 7, -1, -1, -1, -1},
+    {2, 0, 7, 2, 7, 11, 0, 9, 7, 6, 7, 10, 9, 10, 7, -1},
+    {1, 8, 0, 1, 7, 8, 1, 10, 7, 6, 7, 10, 2, 3, 11, -1},
+    {11, 2, 1, 11, 1, 7, 10, 6, 1, 6, 7, 1, -1, -1, -1, -1},
+    {8, 9, 6, 8, 6, 7, 9, 1, 6, 11, 6, 3, 1, 3, 6, -1},
+    {0, 9, 1, 11, 6, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {7, 8, 0, 7, 0, 6, 3, 11, 0, 11, 6, 0, -1, -1, -1, -1},
+    {7, 11, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {7, 6, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {3, 0, 8, 11, 7, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 1, 9, 11, 7, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {8, 1, 9, 8, 3, 1, 11, 7, 6, -1, -1, -1, -1, -1, -1, -1},
+    {10, 1, 2, 6, 11, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {1, 2, 10, 3, 0, 8, 6, 11, 7, -1, -1, -1, -1, -1, -1, -1},
+    {2, 9, 0, 2, 10, 9, 6, 11, 7, -1, -1, -1, -1, -1, -1, -1},
+    {6, 11, 7, 2, 10, 3, 10, 8, 3, 10, 9, 8, -1, -1, -1, -1},
+    {7, 2, 3, 6, 2, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {7, 0, 8, 7, 6, 0, 6, 2, 0, -1, -1, -1, -1, -1, -1, -1},
+    {2, 7, 6, 2, 3, 7, 0, 1, 9, -1, -1, -1, -1, -1, -1, -1},
+    {1, 6, 2, 1, 8, 6, 1, 9, 8, 8, 7, 6, -1, -1, -1, -1},
+    {10, 7, 6, 10, 1, 7, 1, 3, 7, -1, -1, -1, -1, -1, -1, -1},
+    {10, 7, 6, 1, 7, 10, 1, 8, 7, 1, 0, 8, -1, -1, -1, -1},
+    {0, 3, 7, 0, 7, 10, 0, 10, 9, 6, 10, 7, -1, -1, -1, -1},
+    {7, 6, 10, 7, 10, 8, 8, 10, 9, -1, -1, -1, -1, -1, -1, -1},
+    {6, 8, 4, 11, 8, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {3, 6, 11, 3, 0, 6, 0, 4, 6, -1, -1, -1, -1, -1, -1, -1},
+    {8, 6, 11, 8, 4, 6, 9, 0, 1, -1, -1, -1, -1, -1, -1, -1},
+    {9, 4, 6, 9, 6, 3, 9, 3, 1, 11, 3, 6, -1, -1, -1, -1},
+    {6, 8, 4, 6, 11, 8, 2, 10, 1, -1, -1, -1, -1, -1, -1, -1},
+    {1, 2, 10, 3, 0, 11, 0, 6, 11, 0, 4, 6, -1, -1, -1, -1},
+    {4, 11, 8, 4, 6, 11, 0, 2, 9, 2, 10, 9, -1, -1, -1, -1},
+    {10, 9, 3, 10, 3, 2, 9, 4, 3, 11, 3, 6, 4, 6, 3, -1},
+    {8, 2, 3, 8, 4, 2, 4, 6, 2, -1, -1, -1, -1, -1, -1, -1},
+    {0, 4, 2, 4, 6, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {1, 9, 0, 2, 3, 4, 2, 4, 6, 4, 3, 8, -1, -1, -1, -1},
+    {1, 9, 4, 1, 4, 2, 2, 4, 6, -1, -1, -1, -1, -1, -1, -1},
+    {8, 1, 3, 8, 6, 1, 8, 4, 6, 6, 10, 1, -1, -1, -1, -1},
+    {10, 1, 0, 10, 0, 6, 6, 0, 4, -1, -1, -1, -1, -1, -1, -1},
+    {4, 6, 3, 4, 3, 8, 6, 10, 3, 0, 3, 9, 10, 9, 3, -1},
+    {10, 9, 4, 6, 10, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {4, 9, 5, 7, 6, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 8, 3, 4, 9, 5, 11, 7, 6, -1, -1, -1, -1, -1, -1, -1},
+    {5, 0, 1, 5, 4, 0, 7, 6, 11, -1, -1, -1, -1, -1, -1, -1},
+    {11, 7, 6, 8, 3, 4, 3, 5, 4, 3, 1, 5, -1, -1, -1, -1},
+    {9, 5, 4, 10, 1, 2, 7, 6, 11, -1, -1, -1, -1, -1, -1, -1},
+    {6, 11, 7, 1, 2, 10, 0, 8, 3, 4, 9, 5, -1, -1, -1, -1},
+    {7, 6, 11, 5, 4, 10, 4, 2, 10, 4, 0, 2, -1, -1, -1, -1},
+    {3, 4, 8, 3, 5, 4, 3, 2, 5, 10, 5, 2, 11, 7, 6, -1},
+    {7, 2, 3, 7, 6, 2, 5, 4, 9, -1, -1, -1, -1, -1, -1, -1},
+    {9, 5, 4, 0, 8, 6, 0, 6, 2, 6, 8, 7, -1, -1, -1, -1},
+    {3, 6, 2, 3, 7, 6, 1, 5, 0, 5, 4, 0, -1, -1, -1, -1},
+    {6, 2, 8, 6, 8, 7, 2, 1, 8, 4, 8, 5, 1, 5, 8, -1},
+    {9, 5, 4, 10, 1, 6, 1, 7, 6, 1, 3, 7, -1, -1, -1, -1},
+    {1, 6, 10, 1, 7, 6, 1, 0, 7, 8, 7, 0, 9, 5, 4, -1},
+    {4, 0, 10, 4, 10, 5, 0, 3, 10, 6, 10, 7, 3, 7, 10, -1},
+    {7, 6, 10, 7, 10, 8, 5, 4, 10, 4, 8, 10, -1, -1, -1, -1},
+    {6, 9, 5, 6, 11, 9, 11, 8, 9, -1, -1, -1, -1, -1, -1, -1},
+    {3, 6, 11, 0, 6, 3, 0, 5, 6, 0, 9, 5, -1, -1, -1, -1},
+    {0, 11, 8, 0, 5, 11, 0, 1, 5, 5, 6, 11, -1, -1, -1, -1},
+    {6, 11, 3, 6, 3, 5, 5, 3, 1, -1, -1, -1, -1, -1, -1, -1},
+    {1, 2, 10, 9, 5, 11, 9, 11, 8, 11, 5, 6, -1, -1, -1, -1},
+    {0, 11, 3, 0, 6, 11, 0, 9, 6, 5, 6, 9, 1, 2, 10, -1},
+    {11, 8, 5, 11, 5, 6, 8, 0, 5, 10, 5, 2, 0, 2, 5, -1},
+    {6, 11, 3, 6, 3, 5, 2, 10, 3, 10, 5, 3, -1, -1, -1, -1},
+    {5, 8, 9, 5, 2, 8, 5, 6, 2, 3, 8, 2, -1, -1, -1, -1},
+    {9, 5, 6, 9, 6, 0, 0, 6, 2, -1, -1, -1, -1, -1, -1, -1},
+    {1, 5, 8, 1, 8, 0, 5, 6, 8, 3, 8, 2, 6, 2, 8, -1},
+    {1, 5, 6, 2, 1, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {1, 3, 6, 1, 6, 10, 3, 8, 6, 5, 6, 9, 8, 9, 6, -1},
+    {10, 1, 0, 10, 0, 6, 9, 5, 0, 5, 6, 0, -1, -1, -1, -1},
+    {0, 3, 8, 5, 6, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {10, 5, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {11, 5, 10, 7, 5, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {11, 5, 10, 11, 7, 5, 8, 3, 0, -1, -1, -1, -1, -1, -1, -1},
+    {5, 11, 7, 5, 10, 11, 1, 9, 0, -1, -1, -1, -1, -1, -1, -1},
+    {10, 7, 5, 10, 11, 7, 9, 8, 1, 8, 3, 1, -1, -1, -1, -1},
+    {11, 1, 2, 11, 7, 1, 7, 5, 1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 8, 3, 1, 2, 7, 1, 7, 5, 7, 2, 11, -1, -1, -1, -1},
+    {9, 7, 5, 9, 2, 7, 9, 0, 2, 2, 11, 7, -1, -1, -1, -1},
+    {7, 5, 2, 7, 2, 11, 5, 9, 2, 3, 2, 8, 9, 8, 2, -1},
+    {2, 5, 10, 2, 3, 5, 3, 7, 5, -1, -1, -1, -1, -1, -1, -1},
+    {8, 2, 0, 8, 5, 2, 8, 7, 5, 10, 2, 5, -1, -1, -1, -1},
+    {9, 0, 1, 5, 10, 3, 5, 3, 7, 3, 10, 2, -1, -1, -1, -1},
+    {9, 8, 2, 9, 2, 1, 8, 7, 2, 10, 2, 5, 7, 5, 2, -1},
+    {1, 3, 5, 3, 7, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 8, 7, 0, 7, 1, 1, 7, 5, -1, -1, -1, -1, -1, -1, -1},
+    {9, 0, 3, 9, 3, 5, 5, 3, 7, -1, -1, -1, -1, -1, -1, -1},
+    {9, 8, 7, 5, 9, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {5, 8, 4, 5, 10, 8, 10, 11, 8, -1, -1, -1, -1, -1, -1, -1},
+    {5, 0, 4, 5, 11, 0, 5, 10, 11, 11, 3, 0, -1, -1, -1, -1},
+    {0, 1, 9, 8, 4, 10, 8, 10, 11, 10, 4, 5, -1, -1, -1, -1},
+    {10, 11, 4, 10, 4, 5, 11, 3, 4, 9, 4, 1, 3, 1, 4, -1},
+    {2, 5, 1, 2, 8, 5, 2, 11, 8, 4, 5, 8, -1, -1, -1, -1},
+    {0, 4, 11, 0, 11, 3, 4, 5, 11, 2, 11, 1, 5, 1, 11, -1},
+    {0, 2, 5, 0, 5, 9, 2, 11, 5, 4, 5, 8, 11, 8, 5, -1},
+    {9, 4, 5, 2, 11, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {2, 5, 10, 3, 5, 2, 3, 4, 5, 3, 8, 4, -1, -1, -1, -1},
+    {5, 10, 2, 5, 2, 4, 4, 2, 0, -1, -1, -1, -1, -1, -1, -1},
+    {3, 10, 2, 3, 5, 10, 3, 8, 5, 4, 5, 8, 0, 1, 9, -1},
+    {5, 10, 2, 5, 2, 4, 1, 9, 2, 9, 4, 2, -1, -1, -1, -1},
+    {8, 4, 5, 8, 5, 3, 3, 5, 1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 4, 5, 1, 0, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {8, 4, 5, 8, 5, 3, 9, 0, 5, 0, 3, 5, -1, -1, -1, -1},
+    {9, 4, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {4, 11, 7, 4, 9, 11, 9, 10, 11, -1, -1, -1, -1, -1, -1, -1},
+    {0, 8, 3, 4, 9, 7, 9, 11, 7, 9, 10, 11, -1, -1, -1, -1},
+    {1, 10, 11, 1, 11, 4, 1, 4, 0, 7, 4, 11, -1, -1, -1, -1},
+    {3, 1, 4, 3, 4, 8, 1, 10, 4, 7, 4, 11, 10, 11, 4, -1},
+    {4, 11, 7, 9, 11, 4, 9, 2, 11, 9, 1, 2, -1, -1, -1, -1},
+    {9, 7, 4, 9, 11, 7, 9, 1, 11, 2, 11, 1, 0, 8, 3, -1},
+    {11, 7, 4, 11, 4, 2, 2, 4, 0, -1, -1, -1, -1, -1, -1, -1},
+    {11, 7, 4, 11, 4, 2, 8, 3, 4, 3, 2, 4, -1, -1, -1, -1},
+    {2, 9, 10, 2, 7, 9, 2, 3, 7, 7, 4, 9, -1, -1, -1, -1},
+    {9, 10, 7, 9, 7, 4, 10, 2, 7, 8, 7, 0, 2, 0, 7, -1},
+    {3, 7, 10, 3, 10, 2, 7, 4, 10, 1, 10, 0, 4, 0, 10, -1},
+    {1, 10, 2, 8, 7, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {4, 9, 1, 4, 1, 7, 7, 1, 3, -1, -1, -1, -1, -1, -1, -1},
+    {4, 9, 1, 4, 1, 7, 0, 8, 1, 8, 7, 1, -1, -1, -1, -1},
+    {4, 0, 3, 7, 4, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {4, 8, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {9, 10, 8, 10, 11, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {3, 0, 9, 3, 9, 11, 11, 9, 10, -1, -1, -1, -1, -1, -1, -1},
+    {0, 1, 10, 0, 10, 8, 8, 10, 11, -1, -1, -1, -1, -1, -1, -1},
+    {3, 1, 10, 11, 3, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {1, 2, 11, 1, 11, 9, 9, 11, 8, -1, -1, -1, -1, -1, -1, -1},
+    {3, 0, 9, 3, 9, 11, 1, 2, 9, 2, 11, 9, -1, -1, -1, -1},
+    {0, 2, 11, 8, 0, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {3, 2, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {2, 3, 8, 2, 8, 10, 10, 8, 9, -1, -1, -1, -1, -1, -1, -1},
+    {9, 10, 2, 0, 9, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {2, 3, 8, 2, 8, 10, 0, 1, 8, 1, 10, 8, -1, -1, -1, -1},
+    {1, 10, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {1, 3, 8, 9, 1, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 9, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 3, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1}};
+
+// number of triangles generated by each cube configuration.
+constexpr std::array<uint8_t, 256> BuildTrianglesCountTable() {
+  std::array<uint8_t, 256> result = {};
+  for (size_t i = 0; i < 256; ++i) {
+    uint8_t count = 0;
+    while (count < 5 && triTable[i][3 * count] != -1) {
+      count++;
+    }
+    result[i] = count;
+  }
+  return result;
+}
+constexpr std::array<uint8_t, 256> trianglesCountTable =
+    BuildTrianglesCountTable();
+
+// The cells of the grid are processed in cubic blocks, each block can be
+// counted and polygonised independently from the others.
+struct CellBlocks {
+  static constexpr size_t BLOCK_SIZE = BlocksRange::BLOCK_SIZE;
+  size_t cells[3] = {};
+  size_t blocks[3] = {};
+
+  CellBlocks(const Image3D &image) {
+    for (size_t i = 0; i < 3; ++i) {
+      cells[i] = image.size[i] > 0 ? image.size[i] - 1 : 0;
+      blocks[i] = (cells[i] + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    }
+  }
+  size_t Count() const { return blocks[0] * blocks[1] * blocks[2]; }
+  size_t BlockOf(size_t x, size_t y, size_t z) const {
+    return LinearIndex(x / BLOCK_SIZE, y / BLOCK_SIZE, z / BLOCK_SIZE);
+  }
+  size_t LinearIndex(size_t x, size_t y, size_t z) const {
+    return x + y * blocks[0] + z * blocks[0] * blocks[1];
+  }
+  void Index(size_t block, size_t index[3]) const {
+    index[0] = block % blocks[0];
+    index[1] = (block / blocks[0]) % blocks[1];
+    index[2] = block / (blocks[0] * blocks[1]);
+  }
+  void Range(size_t block, size_t begin[3], size_t end[3]) const {
+    size_t index[3];
+    Index(block, index);
+    for (size_t i = 0; i < 3; ++i) {
+      begin[i] = index[i] * BLOCK_SIZE;
+      end[i] = (std::min)(begin[i] + BLOCK_SIZE, cells[i]);
+    }
+  }
+};
+
+// the blocks crossed by the isosurface, only these can generate triangles.
+void ActiveBlocks(const Image3D &image, const CellBlocks &blocks,
+                  float isolevel, std::vector<size_t> &result) {
+  const bool hasBlocksRange = image.blocksRange.min.size() == blocks.Count();
+  const BlocksRange blocksRange =
+      hasBlocksRange ? BlocksRange{} : CalculateBlocksRange(image);
+  const BlocksRange &range = hasBlocksRange ? image.blocksRange : blocksRange;
+  result.clear();
+  for (size_t b = 0; b < blocks.Count(); ++b) {
+    if (range.Contains(b, isolevel)) {
+      result.push_back(b);
+    }
+  }
+}
+
+struct Grid {
+  Vec3f p[8] = {};
+  float val[8] = {};
+};
+
+void SetGridPoint(Grid &grid, const Image3D &image, size_t i, size_t x,
+                  size_t y, size_t z) {
+  grid.val[i] = image.At(x, y, z);
+  grid.p[i].x = image.origin[0] + x * image.spacing[0];
+  grid.p[i].y = image.origin[1] + y * image.spacing[1];
+  grid.p[i].z = image.origin[2] + z * image.spacing[2];
+}
+
+Grid LoadCell(const Image3D &image, size_t x, size_t y, size_t z) {
+  Grid grid;
+  SetGridPoint(grid, image, 0, x, y, z);
+  SetGridPoint(grid, image, 1, x + 1, y, z);
+  SetGridPoint(grid, image, 2, x + 1, y, z + 1);
+  SetGridPoint(grid, image, 3, x, y, z + 1);
+  SetGridPoint(grid, image, 4, x, y + 1, z);
+  SetGridPoint(grid, image, 5, x + 1, y + 1, z);
+  SetGridPoint(grid, image, 6, x + 1, y + 1, z + 1);
+  SetGridPoint(grid, image, 7, x, y + 1, z + 1);
+  return grid;
+}
+
+// offsets of the cell corners along each axis, in the order of the grid points.
+constexpr int cornerOffsets[8][3] = {{0, 0, 0}, {1, 0, 0}, {1, 0, 1},
+                                     {0, 0, 1}, {0, 1, 0}, {1, 1, 0},
+                                     {1, 1, 1}, {0, 1, 1}};
+
+// Loads the cell with the corners lo and hi, which can be several samples
+// apart.
+Grid LoadCell(const Image3D &image, const size_t lo[3], const size_t hi[3]) {
+  Grid grid;
+  for (size_t i = 0; i < 8; ++i) {
+    SetGridPoint(grid, image, i, cornerOffsets[i][0] ? hi[0] : lo[0],
+                 cornerOffsets[i][1] ? hi[1] : lo[1],
+                 cornerOffsets[i][2] ? hi[2] : lo[2]);
+  }
+  return grid;
+}
+
+int CubeIndex(const Grid &grid, float isolevel) {
+  int cubeindex = 0;
+  for (int i = 0; i < 8; ++i) {
+    cubeindex |= int(grid.val[i] < isolevel) << i;
+  }
+  return cubeindex;
+}
+
+// bit i is set if row[i] is inside the surface, n <= 32.
+uint32_t InsideMask(const float *row, size_t n, float isolevel) {
+  uint32_t mask = 0;
+  size_t i = 0;
+#ifdef USE_SSE2
+  const __m128 iso = _mm_set1_ps(isolevel);
+  for (; i + 4 <= n; i += 4) {
+    const __m128 v = _mm_loadu_ps(row + i);
+    mask |= uint32_t(_mm_movemask_ps(_mm_cmplt_ps(v, iso))) << i;
+  }
+#endif
+  for (; i < n; ++i) {
+    mask |= uint32_t(row[i] < isolevel) << i;
+  }
+  return mask;
+}
+
+/*
+    Determine the indices into the edge table which tell us which
+    vertices are inside of the surface, for the cells [begin, end) of
+    the row (y, z). The four sample rows around the cells are classified
+    at once, returns false if no cell of the row is crossed.
+*/
+bool ClassifyRow(const Image3D &image, size_t y, size_t z, size_t begin,
+                 size_t end, float isolevel, uint8_t *cubeIndices) {
+  assert(end - begin < 32);
+  const size_t n = end - begin + 1;
+  const uint32_t a = InsideMask(&image.At(begin, y, z), n, isolevel);
+  const uint32_t b = InsideMask(&image.At(begin, y + 1, z), n, isolevel);
+  const uint32_t c = InsideMask(&image.At(begin, y, z + 1), n, isolevel);
+  const uint32_t d = InsideMask(&image.At(begin, y + 1, z + 1), n, isolevel);
+  // built in 64 bits, a row can have all the 32 samples.
+  const uint32_t full = uint32_t((uint64_t(1) << n) - 1);
+  if ((a | b | c | d) == 0 || (a & b & c & d) == full) {
+    return false;
+  }
+  for (size_t i = 0; i + 1 < n; ++i) {
+    cubeIndices[i] = ((a >> i) & 1) | ((a >> (i + 1)) & 1) << 1 |
+                     ((c >> (i + 1)) & 1) << 2 | ((c >> i) & 1) << 3 |
+                     ((b >> i) & 1) << 4 | ((b >> (i + 1)) & 1) << 5 |
+                     ((d >> (i + 1)) & 1) << 6 | ((d >> i) & 1) << 7;
+  }
+  return true;
+}
+
+// corners of the cell edges, in the order of the edge table bits.
+constexpr int edgeCorners[12][2] = {{0, 1}, {1, 2}, {2, 3}, {3, 0},
+                                    {4, 5}, {5, 6}, {6, 7}, {7, 4},
+                                    {0, 4}, {1, 5}, {2, 6}, {3, 7}};
+
+// Interpolates along the edge always from its lowest corner, so that the
+// cells sharing an edge generate exactly the same point.
+Vec3f EdgeIntersection(const Grid &grid, size_t edge, float isolevel) {
+  int c0 = edgeCorners[edge][0];
+  int c1 = edgeCorners[edge][1];
+  if (grid.p[c1].x < grid.p[c0].x || grid.p[c1].y < grid.p[c0].y ||
+      grid.p[c1].z < grid.p[c0].z) {
+    std::swap(c0, c1);
+  }
+  return Lerp(isolevel, grid.p[c0], grid.p[c1], grid.val[c0], grid.val[c1]);
+}
+
+// Writes the triangles of one cell starting at faces/vertices, every triangle
+// owns its 3 vertices. returns the number of triangles written.
+size_t PolygoniseCell(const Grid &grid, int cubeindex, float isolevel,
+                      uint32_t firstVertex, Vec3f *vertices,
+                      Mesh::Triangle *faces) {
+  /* Cube is entirely in/out of the surface */
+  if (edgeTable[cubeindex] == 0) {
+    return 0;
+  }
+
+  Vec3f vertexList[12] = {};
+
+  /* Find the vertices where the surface intersects the cube */
+  for (size_t e = 0; e < 12; ++e) {
+    if (edgeTable[cubeindex] & (1 << e)) {
+      vertexList[e] = EdgeIntersection(grid, e, isolevel);
+    }
+  }
+
+  /* Create the triangles */
+  const size_t count = trianglesCountTable[cubeindex];
+  for (size_t i = 0; i < count; ++i) {
+    for (size_t j = 0; j < 3; ++j) {
+      const uint32_t v = firstVertex + uint32_t(3 * i + j);
+      vertices[3 * i + j] = vertexList[triTable[cubeindex][3 * i + j]];
+      faces[i][j] = v;
+    }
+  }
+  return count;
+}
+
+// Marching cubes over the given blocks, the triangles are counted first so
+// that the output is allocated once and every block writes at its offset.
+void PolygoniseBlocks(const Image3D &image, const CellBlocks &blocks,
+                      const std::vector<size_t> &blockList, float isolevel,
+                      Mesh &mesh) {
+  const int64_t blocksCount = blockList.size();
+
+  // first pass: count the triangles generated by every block.
+  struct Offsets;
+  std::vector<size_t> &offsets = ScratchVector<Offsets, size_t>();
+  offsets.assign(blocksCount + 1, 0);
+#pragma omp parallel for schedule(dynamic)
+  for (int64_t b = 0; b < blocksCount; ++b) {
+    size_t begin[3], end[3];
+    blocks.Range(blockList[b], begin, end);
+    size_t count = 0;
+    uint8_t cubeIndices[CellBlocks::BLOCK_SIZE];
+    for (size_t z = begin[2]; z < end[2]; z++) {
+      for (size_t y = begin[1]; y < end[1]; y++) {
+        if (!ClassifyRow(image, y, z, begin[0], end[0], isolevel,
+                         cubeIndices)) {
+          continue;
+        }
+        for (size_t x = begin[0]; x < end[0]; x++) {
+          count += trianglesCountTable[cubeIndices[x - begin[0]]];
+        }
+      }
+    }
+    offsets[b + 1] = count;
+  }
+  for (int64_t b = 0; b < blocksCount; ++b) {
+    offsets[b + 1] += offsets[b];
+  }
+
+  // the exact output size is known, allocate it once.
+  const size_t facesCount = offsets[blocksCount];
+  mesh.faces.resize(facesCount);
+  mesh.vertices.resize(3 * facesCount);
+
+  // second pass: every block writes its triangles at its own offset, and
+  // bounds them while they are still in the cache.
+  struct Boxes;
+  std::vector<BBox> &boxes = ScratchVector<Boxes, BBox>();
+  boxes.resize(blocksCount);
+#pragma omp parallel for schedule(dynamic)
+  for (int64_t b = 0; b < blocksCount; ++b) {
+    size_t begin[3], end[3];
+    blocks.Range(blockList[b], begin, end);
+    size_t face = offsets[b];
+    uint8_t cubeIndices[CellBlocks::BLOCK_SIZE];
+    for (size_t z = begin[2]; z < end[2]; z++) {
+      for (size_t y = begin[1]; y < end[1]; y++) {
+        if (!ClassifyRow(image, y, z, begin[0], end[0], isolevel,
+                         cubeIndices)) {
+          continue;
+        }
+        for (size_t x = begin[0]; x < end[0]; x++) {
+          const int cubeindex = cubeIndices[x - begin[0]];
+          if (edgeTable[cubeindex] == 0) {
+            continue;
+          }
+          face += PolygoniseCell(LoadCell(image, x, y, z), cubeindex,
+                                 isolevel, uint32_t(3 * face),
+                                 &mesh.vertices[3 * face], &mesh.faces[face]);
+        }
+      }
+    }
+    assert(face == offsets[b + 1]);
+    boxes[b] = CalculateBBox(&mesh.vertices[3 * offsets[b]],
+                             3 * (face - offsets[b]));
+  }
+  mesh.box = BBox{};
+  for (const BBox &box : boxes) {
+    if (box.IsValid()) {
+      mesh.box.Merge(box);
+    }
+  }
+}
+
+// Values range of the samples used by the cells of block b.
+void UpdateBlockRange(const Image3D &image, const CellBlocks &cells, size_t b,
+                      BlocksRange &range) {
+  size_t begin[3], end[3];
+  cells.Range(b, begin, end);
+  float min = FLT_MAX;
+  float max = -FLT_MAX;
+  // the block covers the samples on both sides of its cells.
+  for (size_t z = begin[2]; z <= end[2]; z++) {
+    for (size_t y = begin[1]; y <= end[1]; y++) {
+      for (size_t x = begin[0]; x <= end[0]; x++) {
+        const float v = image.At(x, y, z);
+        min = (std::min)(min, v);
+        max = (std::max)(max, v);
+      }
+    }
+  }
+  range.min[b] = min;
+  range.max[b] = max;
+}
+
+// Appends the triangles of one cell to the mesh.
+void AppendCell(const Grid &grid, int cubeindex, float isolevel, Mesh &mesh) {
+  const size_t first = mesh.faces.size();
+  const size_t count = trianglesCountTable[cubeindex];
+  mesh.faces.resize(first + count);
+  mesh.vertices.resize(3 * (first + count));
+  PolygoniseCell(grid, cubeindex, isolevel, uint32_t(3 * first),
+                 &mesh.vertices[3 * first], &mesh.faces[first]);
+}
+
+// A surface point on the edge [lo, hi] of a transition face, the points of the
+// fine and of the coarse cells are kept apart even on the same edge.
+struct TransitionPoint {
+  size_t lo[3];
+  size_t hi[3];
+  bool coarse;
+  Vec3f p;
+  int segments[2];
+  int degree;
+};
+
+struct TransitionSegment {
+  int from, to;
+  // the segments on the sides of the transition cells have no orientation.
+  bool oriented;
+};
+
+/*
+    Closes the cracks on the face f (-x, +x, -y, +y, -z, +z) of the chunk
+    cells [begin, end), sampled every step, with its neighbour sampled every
+    step / 2. On every coarse cell of the face, the borders of the fine and of
+    the coarse surfaces and the segments joining them on the cell sides make
+    closed loops in the face plane, which are filled with triangle fans. The
+    borders are taken from the triangles of the cells on both sides, so the
+    loops follow exactly the marching cubes cases of both chunks.
+*/
+void PolygoniseTransitionFace(const Image3D &image, const CellBlocks &blocks,
+                              const size_t begin[3], const size_t end[3],
+                              size_t f, size_t step, float isolevel,
+                              Mesh &mesh) {
+  const size_t a = f / 2;
+  const bool maxSide = f & 1;
+  const size_t u = (a + 1) % 3;
+  const size_t v = (a + 2) % 3;
+  const size_t half = step / 2;
+  const size_t plane = maxSide ? end[a] : begin[a];
+  // the other samples of the cells on both sides of the face.
+  const size_t coarseDepth =
+      maxSide ? plane - step : (std::min)(plane + step, blocks.cells[a]);
+  const size_t fineDepth =
+      maxSide ? (std::min)(plane + half, blocks.cells[a]) : plane - half;
+
+  std::vector<TransitionPoint> points;
+  std::vector<TransitionSegment> segments;
+  const auto Sample = [&](const size_t c[3]) {
+    return image.At(c[0], c[1], c[2]);
+  };
+  const auto Point = [&](const size_t lo[3], const size_t hi[3], bool coarse) {
+    for (size_t i = 0; i < points.size(); ++i) {
+      const TransitionPoint &tp = points[i];
+      if (tp.coarse == coarse && std::equal(lo, lo + 3, tp.lo) &&
+          std::equal(hi, hi + 3, tp.hi)) {
+        return int(i);
+      }
+    }
+    TransitionPoint tp{{lo[0], lo[1], lo[2]}, {hi[0], hi[1], hi[2]}, coarse,
+                       Vec3f{}, {-1, -1}, 0};
+    Vec3f p0, p1;
+    for (size_t i = 0; i < 3; ++i) {
+      p0[i] = image.origin[i] + lo[i] * image.spacing[i];
+      p1[i] = image.origin[i] + hi[i] * image.spacing[i];
+    }
+    tp.p = Lerp(isolevel, p0, p1, Sample(lo), Sample(hi));
+    points.push_back(tp);
+    return int(points.size() - 1);
+  };
+  const auto AddSegment = [&](int from, int to, bool oriented) {
+    const int id = segments.size();
+    segments.push_back(TransitionSegment{from, to, oriented});
+    for (const int i : {from, to}) {
+      TransitionPoint &tp = points[i];
+      if (tp.degree < 2) {
+        tp.segments[tp.degree] = id;
+      }
+      tp.degree++;
+    }
+  };
+  // the borders of the cell [lo, hi] surface on its face lying in the plane,
+  // reversed so that the fill is oriented as the cell triangles.
+  const auto AddCellBorders = [&](const size_t lo[3], const size_t hi[3],
+                                  int side, bool coarse) {
+    const Grid grid = LoadCell(image, lo, hi);
+    const int cubeindex = CubeIndex(grid, isolevel);
+    const auto OnFace = [&](int e) {
+      return cornerOffsets[edgeCorners[e][0]][a] == side &&
+             cornerOffsets[edgeCorners[e][1]][a] == side;
+    };
+    const auto EdgePoint = [&](int e) {
+      size_t p0[3], p1[3];
+      for (size_t i = 0; i < 3; ++i) {
+        p0[i] = cornerOffsets[edgeCorners[e][0]][i] ? hi[i] : lo[i];
+        p1[i] = cornerOffsets[edgeCorners[e][1]][i] ? hi[i] : lo[i];
+      }
+      return std::lexicographical_compare(p1, p1 + 3, p0, p0 + 3)
+                 ? Point(p1, p0, coarse)
+                 : Point(p0, p1, coarse);
+    };
+    std::pair<int, int> borders[12];
+    size_t bordersCount = 0;
+    for (size_t t = 0; t < trianglesCountTable[cubeindex]; ++t) {
+      for (size_t j = 0; j < 3; ++j) {
+        const int e0 = triTable[cubeindex][3 * t + j];
+        const int e1 = triTable[cubeindex][3 * t + (j + 1) % 3];
+        if (e0 == e1 || !OnFace(e0) || !OnFace(e1)) {
+          continue;
+        }
+        // an edge shared by two triangles is not a border.
+        size_t k = 0;
+        while (k < bordersCount &&
+               !(borders[k].first == e1 && borders[k].second == e0) &&
+               !(borders[k].first == e0 && borders[k].second == e1)) {
+          ++k;
+        }
+        if (k < bordersCount) {
+          borders[k] = borders[--bordersCount];
+        } else {
+          borders[bordersCount++] = {e0, e1};
+        }
+      }
+    }
+    for (size_t k = 0; k < bordersCount; ++k) {
+      AddSegment(EdgePoint(borders[k].second), EdgePoint(borders[k].first),
+                 true);
+    }
+  };
+
+  for (size_t v0 = begin[v]; v0 < end[v]; v0 += step) {
+    const size_t v1 = (std::min)(v0 + step, end[v]);
+    for (size_t u0 = begin[u]; u0 < end[u]; u0 += step) {
+      const size_t u1 = (std::min)(u0 + step, end[u]);
+      // the fine samples of the face of the coarse cell.
+      size_t us[3] = {u0, u0 + half, u1}, vs[3] = {v0, v0 + half, v1};
+      const size_t uCount = u0 + half < u1 ? 3 : 2;
+      const size_t vCount = v0 + half < v1 ? 3 : 2;
+      us[uCount - 1] = u1;
+      vs[vCount - 1] = v1;
+      const auto FacePoint = [&](size_t i, size_t j, size_t c[3]) {
+        c[a] = plane;
+        c[u] = i;
+        c[v] = j;
+      };
+
+      int inside = 0;
+      for (size_t j = 0; j < vCount; ++j) {
+        for (size_t i = 0; i < uCount; ++i) {
+          size_t c[3];
+          FacePoint(us[i], vs[j], c);
+          inside += Sample(c) < isolevel;
+        }
+      }
+      if (inside == 0 || inside == int(uCount * vCount)) {
+        continue;
+      }
+
+      points.clear();
+      segments.clear();
+      for (size_t j = 0; j + 1 < vCount; ++j) {
+        for (size_t i = 0; i + 1 < uCount; ++i) {
+          size_t lo[3], hi[3];
+          FacePoint(us[i], vs[j], lo);
+          FacePoint(us[i + 1], vs[j + 1], hi);
+          lo[a] = maxSide ? plane : fineDepth;
+          hi[a] = maxSide ? fineDepth : plane;
+          AddCellBorders(lo, hi, maxSide ? 0 : 1, false);
+        }
+      }
+      {
+        size_t lo[3], hi[3];
+        FacePoint(u0, v0, lo);
+        FacePoint(u1, v1, hi);
+        lo[a] = maxSide ? coarseDepth : plane;
+        hi[a] = maxSide ? plane : coarseDepth;
+        AddCellBorders(lo, hi, maxSide ? 1 : 0, true);
+      }
+      // the sides of the cell join the fine and the coarse borders.
+      for (size_t side = 0; side < 4; ++side) {
+        const bool alongV = side < 2;
+        const size_t fixed = (side & 1) ? (alongV ? u1 : v1) : (alongV ? u0 : v0);
+        const size_t *samples = alongV ? vs : us;
+        const size_t count = alongV ? vCount : uCount;
+        const auto LinePoint = [&](size_t k, size_t c[3]) {
+          alongV ? FacePoint(fixed, k, c) : FacePoint(k, fixed, c);
+        };
+        int ends[2];
+        size_t endsCount = 0;
+        for (size_t k = 0; k < count; ++k) {
+          // the fine edges, then the coarse edge.
+          size_t lo[3], hi[3];
+          const bool coarse = k + 1 == count;
+          LinePoint(coarse ? samples[0] : samples[k], lo);
+          LinePoint(coarse ? samples[count - 1] : samples[k + 1], hi);
+          if ((Sample(lo) < isolevel) != (Sample(hi) < isolevel) &&
+              endsCount < 2) {
+            ends[endsCount++] = Point(lo, hi, coarse);
+          }
+        }
+        if (endsCount == 2) {
+          AddSegment(ends[0], ends[1], false);
+        }
+      }
+
+      // walk the loops from their oriented segments and fill them.
+      std::vector<uint8_t> visited(segments.size(), 0);
+      std::vector<int> loop;
+      for (size_t s = 0; s < segments.size(); ++s) {
+        if (visited[s] || !segments[s].oriented) {
+          continue;
+        }
+        visited[s] = 1;
+        loop.assign(1, segments[s].from);
+        int at = segments[s].to;
+        int previous = s;
+        while (at != loop[0] && points[at].degree == 2) {
+          loop.push_back(at);
+          const TransitionPoint &tp = points[at];
+          const int next =
+              tp.segments[0] == previous ? tp.segments[1] : tp.segments[0];
+          if (visited[next]) {
+            break;
+          }
+          visited[next] = 1;
+          at = segments[next].from == at ? segments[next].to
+                                         : segments[next].from;
+          previous = next;
+        }
+        if (at != loop[0]) {
+          continue;
+        }
+        for (size_t k = 1; k + 1 < loop.size(); ++k) {
+          const Vec3f &p0 = points[loop[0]].p;
+          const Vec3f &p1 = points[loop[k]].p;
+          const Vec3f &p2 = points[loop[k + 1]].p;
+          if (p0 == p1 || p1 == p2 || p2 == p0) {
+            continue;
+          }
+          const uint32_t first = mesh.vertices.size();
+          mesh.vertices.push_back(p0);
+          mesh.vertices.push_back(p1);
+          mesh.vertices.push_back(p2);
+          mesh.faces.push_back(Mesh::Triangle{first, first + 1, first + 2});
+        }
+      }
+    }
+  }
+}
+
+/*
+    Marching cubes over the active blocks of the chunk (x, y, z), with cells
+    of 2^lod samples. The faces of the chunk set in transitions border a chunk
+    with a lod one finer, and are closed with transition cells.
+*/
+void PolygoniseChunk(const Image3D &image, const CellBlocks &blocks,
+                     const BlocksRange &range, size_t x, size_t y, size_t z,
+                     uint8_t lod, uint8_t transitions, float isolevel,
+                     Mesh &mesh) {
+  constexpr size_t N = ChunkedMesh::CHUNK_BLOCKS;
+  const size_t begin[3] = {x * N, y * N, z * N};
+  const size_t end[3] = {(std::min)(begin[0] + N, blocks.blocks[0]),
+                         (std::min)(begin[1] + N, blocks.blocks[1]),
+                         (std::min)(begin[2] + N, blocks.blocks[2])};
+  std::vector<size_t> blockList;
+  for (size_t bz = begin[2]; bz < end[2]; ++bz) {
+    for (size_t by = begin[1]; by < end[1]; ++by) {
+      for (size_t bx = begin[0]; bx < end[0]; ++bx) {
+        const size_t b = blocks.LinearIndex(bx, by, bz);
+        if (range.Contains(b, isolevel)) {
+          blockList.push_back(b);
+        }
+      }
+    }
+  }
+  mesh = Mesh{};
+  mesh.id = GenerateID();
+  if (lod == 0) {
+    PolygoniseBlocks(image, blocks, blockList, isolevel, mesh);
+    return;
+  }
+
+  // the cells of a block at any lod stay inside the block, so the inactive
+  // blocks are still skipped.
+  static_assert((size_t(1) << ChunkedMesh::MAX_LOD) <= CellBlocks::BLOCK_SIZE,
+                "cells larger than a block");
+  const size_t step = size_t(1) << lod;
+  for (const size_t b : blockList) {
+    size_t lo[3], hi[3], blockBegin[3], blockEnd[3];
+    blocks.Range(b, blockBegin, blockEnd);
+    for (lo[2] = blockBegin[2]; lo[2] < blockEnd[2]; lo[2] += step) {
+      hi[2] = (std::min)(lo[2] + step, blockEnd[2]);
+      for (lo[1] = blockBegin[1]; lo[1] < blockEnd[1]; lo[1] += step) {
+        hi[1] = (std::min)(lo[1] + step, blockEnd[1]);
+        for (lo[0] = blockBegin[0]; lo[0] < blockEnd[0]; lo[0] += step) {
+          hi[0] = (std::min)(lo[0] + step, blockEnd[0]);
+          const Grid grid = LoadCell(image, lo, hi);
+          const int cubeindex = CubeIndex(grid, isolevel);
+          if (edgeTable[cubeindex] != 0) {
+            AppendCell(grid, cubeindex, isolevel, mesh);
+          }
+        }
+      }
+    }
+  }
+
+  size_t cellsBegin[3], cellsEnd[3];
+  for (size_t i = 0; i < 3; ++i) {
+    cellsBegin[i] = begin[i] * CellBlocks::BLOCK_SIZE;
+    cellsEnd[i] = (std::min)(end[i] * CellBlocks::BLOCK_SIZE, blocks.cells[i]);
+  }
+  for (size_t f = 0; f < 6; ++f) {
+    if (transitions & (1 << f)) {
+      PolygoniseTransitionFace(image, blocks, cellsBegin, cellsEnd, f, step,
+                               isolevel, mesh);
+    }
+  }
+  mesh.box = CalculateBBox(mesh.vertices.data(), mesh.vertices.size());
+}
+// the splitmix64 finalizer.
+uint64_t Mix(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ull;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebull;
+  return x ^ (x >> 31);
+}
+
+// a mesh edge identified by the positions of its two vertices, in any order,
+// so the vertices duplicated at the same position (an unwelded mesh) give the
+// same key.
+uint64_t EdgeKey(const Vec3f &a, const Vec3f &b) {
+  const auto PointKey = [](const Vec3f &p) {
+    uint64_t key = 0;
+    for (int k = 0; k < 3; ++k) {
+      const float c = p[k] + 0.0f; // -0 and 0 are the same position
+      uint32_t bits;
+      std::memcpy(&bits, &c, sizeof(bits));
+      key = Mix(key ^ (bits + 0x9e3779b97f4a7c15ull));
+    }
+    return key;
+  };
+  const uint64_t ka = PointKey(a), kb = PointKey(b);
+  return Mix((std::min)(ka, kb) ^ Mix((std::max)(ka, kb)));
+}
+
+// The segments of some slices, with the mesh or grid edges they start and end
+// on.
+struct SegmentsBuffer {
+  std::vector<Vec2f> starts;
+  std::vector<Vec2f> ends;
+  std::vector<uint64_t> startEdges;
+  std::vector<uint64_t> endEdges;
+};
+
+// flags of the segments sorted by ChainSegments.
+constexpr uint8_t CONTOUR_START = 1;
+constexpr uint8_t CONTOUR_CLOSED = 2;
+
+// Links the segments whose end lies on the mesh edge the next one starts on.
+// Every chain is walked back to its first segment before being followed, so
+// that the slices of open meshes give whole open polylines. The segments are
+// sorted in place by contour, and the first segment of every contour is
+// flagged with CONTOUR_START, and CONTOUR_CLOSED if it is closed. Returns the
+// contours count.
+size_t ChainSegments(Vec2f *starts, Vec2f *ends, const uint64_t *startEdges,
+                     const uint64_t *endEdges, uint8_t *flags, size_t count) {
+  using Link = std::pair<uint64_t, uint32_t>;
+  struct ByStart;
+  struct ByEnd;
+  struct Used;
+  struct Order;
+  struct Points;
+  std::vector<Link> &byStart = ScratchVector<ByStart, Link>();
+  std::vector<Link> &byEnd = ScratchVector<ByEnd, Link>();
+  std::vector<uint8_t> &used = ScratchVector<Used, uint8_t>();
+  std::vector<uint32_t> &order = ScratchVector<Order, uint32_t>();
+  std::vector<Vec2f> &points = ScratchVector<Points, Vec2f>();
+  byStart.resize(count);
+  byEnd.resize(count);
+  for (size_t i = 0; i < count; ++i) {
+    byStart[i] = Link{startEdges[i], i};
+    byEnd[i] = Link{endEdges[i], i};
+  }
+  std::sort(byStart.begin(), byStart.end());
+  std::sort(byEnd.begin(), byEnd.end());
+  used.assign(count, false);
+  // an unused segment linked to edge, count if none.
+  const auto Find = [&](const std::vector<Link> &links, uint64_t edge) {
+    auto it = std::lower_bound(links.begin(), links.end(), Link{edge, 0});
+    for (; it != links.end() && it->first == edge; ++it) {
+      if (!used[it->second]) {
+        return size_t(it->second);
+      }
+    }
+    return count;
+  };
+
+  order.clear();
+  size_t contoursCount = 0;
+  for (size_t i = 0; i < count; ++i) {
+    if (used[i]) {
+      continue;
+    }
+    // the walk back stops after count steps on the non-manifold cycles that
+    // don't go through i.
+    size_t first = i;
+    for (size_t steps = 0; steps < count; ++steps) {
+      const size_t prev = Find(byEnd, startEdges[first]);
+      if (prev == count || prev == i) {
+        break;
+      }
+      first = prev;
+    }
+
+    const size_t contourStart = order.size();
+    size_t s = first;
+    while (true) {
+      used[s] = true;
+      order.push_back(s);
+      flags[order.size() - 1] = 0;
+      const size_t next = Find(byStart, endEdges[s]);
+      if (next == count) {
+        break;
+      }
+      s = next;
+    }
+    flags[contourStart] = CONTOUR_START;
+    if (endEdges[s] == startEdges[first]) {
+      flags[contourStart] |= CONTOUR_CLOSED;
+    }
+    ++contoursCount;
+  }
+
+  points.resize(2 * count);
+  std::copy(starts, starts + count, points.begin());
+  std::copy(ends, ends + count, points.begin() + count);
+  for (size_t i = 0; i < count; ++i) {
+    starts[i] = points[order[i]];
+    ends[i] = points[count + order[i]];
+  }
+  return contoursCount;
+}
+
+// The areas of the contours of set and the boxes of its slices.
+void CalculateContoursShape(SliceSet &set) {
+  const int64_t slicesCount = set.Count();
+  const int64_t contoursCount = set.ContoursCount();
+  set.boxes.resize(slicesCount);
+#pragma omp parallel for
+  for (int64_t i = 0; i < slicesCount; ++i) {
+    BBox box;
+    for (size_t k = set.segmentOffsets[i]; k < set.segmentOffsets[i + 1]; ++k) {
+      box.Merge(Vec3f{set.starts[k].x, set.starts[k].y, 0});
+      box.Merge(Vec3f{set.ends[k].x, set.ends[k].y, 0});
+    }
+    set.boxes[i] = box;
+  }
+#pragma omp parallel for
+  for (int64_t c = 0; c < contoursCount; ++c) {
+    const size_t first = set.contourSegments[c];
+    const size_t last = set.contourSegments[c + 1];
+    // the points are the starts, then the end of the last segment of the
+    // open contours.
+    const auto Point = [&](size_t k) {
+      return k < last ? set.starts[k] : set.ends[last - 1];
+    };
+    const size_t end = set.contourClosed[c] ? last : last + 1;
+    double area = 0;
+    for (size_t k = first; k < end; ++k) {
+      const Vec2f a = Point(k);
+      const Vec2f b = Point(k + 1 < end ? k + 1 : first);
+      area += double(a.x) * b.y - double(b.x) * a.y;
+    }
+    set.contourAreas[c] = area / 2;
+  }
+}
+
+// Fills the contours and boxes of set from its segments, whose edges are
+// given in the same order.
+void BuildContours(const std::vector<uint64_t> &startEdges,
+                   const std::vector<uint64_t> &endEdges, SliceSet &set) {
+  const int64_t slicesCount = set.Count();
+  struct Flags;
+  std::vector<uint8_t> &flags = ScratchVector<Flags, uint8_t>();
+  flags.resize(set.starts.size());
+  set.contourOffsets.assign(slicesCount + 1, 0);
+#pragma omp parallel for schedule(dynamic)
+  for (int64_t i = 0; i < slicesCount; ++i) {
+    const size_t first = set.segmentOffsets[i];
+    const size_t count = set.segmentOffsets[i + 1] - first;
+    set.contourOffsets[i + 1] = ChainSegments(
+        set.starts.data() + first, set.ends.data() + first,
+        startEdges.data() + first, endEdges.data() + first,
+        flags.data() + first, count);
+  }
+  for (int64_t i = 0; i < slicesCount; ++i) {
+    set.contourOffsets[i + 1] += set.contourOffsets[i];
+  }
+
+  const int64_t contoursCount = set.contourOffsets[slicesCount];
+  set.contourSegments.resize(contoursCount + 1);
+  set.contourAreas.resize(contoursCount);
+  set.contourClosed.resize(contoursCount);
+#pragma omp parallel for schedule(dynamic)
+  for (int64_t i = 0; i < slicesCount; ++i) {
+    size_t c = set.contourOffsets[i];
+    for (size_t k = set.segmentOffsets[i]; k < set.segmentOffsets[i + 1]; ++k) {
+      if (flags[k] & CONTOUR_START) {
+        set.contourSegments[c] = k;
+        set.contourClosed[c] = (flags[k] & CONTOUR_CLOSED) != 0;
+        ++c;
+      }
+    }
+  }
+  set.contourSegments[contoursCount] = set.starts.size();
+  CalculateContoursShape(set);
+}
+
+// Marching squares over a nu x nv plane of samples, inside below isolevel.
+// The corners and edges of a cell are numbered counter clockwise from
+// (x, y), and a segment goes from an edge leaving the inside to an edge
+// entering it, so the inside is on its left. The crossed grid edges are the
+// keys linking the segments into contours. The segments are appended to
+// buffer.
+void MarchSquares(const float *values, size_t nu, size_t nv,
+                  const float origin[2], const float spacing[2],
+                  float isolevel, SegmentsBuffer &buffer) {
+  for (size_t y = 0; y + 1 < nv; ++y) {
+    for (size_t x = 0; x + 1 < nu; ++x) {
+      const size_t corners[4][2] = {{x, y}, {x + 1, y}, {x + 1, y + 1},
+                                    {x, y + 1}};
+      float v[4];
+      bool inside[4];
+      size_t insideCount = 0;
+      for (size_t c = 0; c < 4; ++c) {
+        v[c] = values[corners[c][0] + corners[c][1] * nu];
+        inside[c] = v[c] < isolevel;
+        insideCount += inside[c];
+      }
+      if (insideCount == 0 || insideCount == 4) {
+        continue;
+      }
+      // edge c joins the corners c and c + 1, the horizontal grid edge from
+      // (x, y) has the key 2 (x + y nu), the vertical one the next key.
+      const auto EdgeId = [&](size_t c) -> uint64_t {
+        const size_t *a = corners[c];
+        const size_t *b = corners[(c + 1) % 4];
+        const size_t lx = (std::min)(a[0], b[0]);
+        const size_t ly = (std::min)(a[1], b[1]);
+        return 2 * (lx + ly * nu) + (a[0] == b[0]);
+      };
+      const auto EdgePoint = [&](size_t c) {
+        const size_t d = (c + 1) % 4;
+        const float t = (isolevel - v[c]) / (v[d] - v[c]);
+        Vec2f p;
+        for (size_t i = 0; i < 2; ++i) {
+          const float a = corners[c][i];
+          const float b = corners[d][i];
+          p[i] = origin[i] + spacing[i] * (a + t * (b - a));
+        }
+        return p;
+      };
+      // in a saddle cell the two insides are joined if the center is inside.
+      const bool saddle = insideCount == 2 && inside[0] == inside[2];
+      const bool joined = (v[0] + v[1] + v[2] + v[3]) * 0.25f < isolevel;
+      for (size_t c = 0; c < 4; ++c) {
+        if (!inside[c] || inside[(c + 1) % 4]) {
+          continue;
+        }
+        size_t entry = (c + 1) % 4;
+        if (saddle && !joined) {
+          entry = (c + 3) % 4;
+        } else {
+          while (inside[entry] || !inside[(entry + 1) % 4]) {
+            entry = (entry + 1) % 4;
+          }
+        }
+        buffer.starts.push_back(EdgePoint(c));
+        buffer.ends.push_back(EdgePoint(entry));
+        buffer.startEdges.push_back(EdgeId(c));
+        buffer.endEdges.push_back(EdgeId(entry));
+      }
+    }
+  }
+}
+
+// Runs MarchSquares on the planes filled by sample(i, values), which returns
+// the position of plane i. Every thread appends the segments of its planes to
+// its own buffer, and they are gathered into set once all the planes are
+// counted.
+template <typename Sample>
+void MarchPlanes(size_t slicesCount, size_t nu, size_t nv,
+                 const float origin[2], const float spacing[2],
+                 const Sample &sample, SliceSet &set) {
+  struct Buffers;
+  struct Threads;
+  struct Begins;
+  std::vector<SegmentsBuffer> &buffers =
+      ScratchVector<Buffers, SegmentsBuffer>();
+  std::vector<uint32_t> &threads = ScratchVector<Threads, uint32_t>();
+  std::vector<uint32_t> &begins = ScratchVector<Begins, uint32_t>();
+  buffers.resize(omp_get_max_threads());
+  threads.resize(slicesCount);
+  begins.resize(slicesCount);
+  set.positions.resize(slicesCount);
+  set.segmentOffsets.assign(slicesCount + 1, 0);
+#pragma omp parallel
+  {
+    const int thread = omp_get_thread_num();
+    SegmentsBuffer &buffer = buffers[thread];
+    buffer.starts.clear();
+    buffer.ends.clear();
+    buffer.startEdges.clear();
+    buffer.endEdges.clear();
+#pragma omp for schedule(dynamic)
+    for (int64_t i = 0; i < int64_t(slicesCount); ++i) {
+      struct Layer;
+      std::vector<float> &layer = ScratchVector<Layer, float>();
+      layer.resize(nu * nv);
+      set.positions[i] = sample(i, layer.data());
+      threads[i] = thread;
+      begins[i] = buffer.starts.size();
+      MarchSquares(layer.data(), nu, nv, origin, spacing, 0, buffer);
+      set.segmentOffsets[i + 1] = buffer.starts.size() - begins[i];
+    }
+  }
+  for (size_t i = 0; i < slicesCount; ++i) {
+    set.segmentOffsets[i + 1] += set.segmentOffsets[i];
+  }
+
+  const size_t segmentsCount = set.segmentOffsets[slicesCount];
+  struct StartEdges;
+  struct EndEdges;
+  std::vector<uint64_t> &startEdges = ScratchVector<StartEdges, uint64_t>();
+  std::vector<uint64_t> &endEdges = ScratchVector<EndEdges, uint64_t>();
+  set.starts.resize(segmentsCount);
+  set.ends.resize(segmentsCount);
+  startEdges.resize(segmentsCount);
+  endEdges.resize(segmentsCount);
+#pragma omp parallel for
+  for (int64_t i = 0; i < int64_t(slicesCount); ++i) {
+    const SegmentsBuffer &buffer = buffers[threads[i]];
+    const size_t first = begins[i];
+    const size_t last = first + set.segmentOffsets[i + 1] -
+                        set.segmentOffsets[i];
+    const size_t to = set.segmentOffsets[i];
+    std::copy(buffer.starts.begin() + first, buffer.starts.begin() + last,
+              set.starts.begin() + to);
+    std::copy(buffer.ends.begin() + first, buffer.ends.begin() + last,
+              set.ends.begin() + to);
+    std::copy(buffer.startEdges.begin() + first,
+              buffer.startEdges.begin() + last, startEdges.begin() + to);
+    std::copy(buffer.endEdges.begin() + first, buffer.endEdges.begin() + last,
+              endEdges.begin() + to);
+  }
+  BuildContours(startEdges, endEdges, set);
+}
+
+// squared distance from p to the segment [a, b].
+float PointToSegmentDistance2(const Vec2f &p, const Vec2f &a, const Vec2f &b) {
+  const Vec2f ab = b - a;
+  const float length2 = Length2(ab);
+  const float t =
+      length2 > 0 ? std::clamp(DotProduct(p - a, ab) / length2, 0.0f, 1.0f)
+                  : 0.0f;
+  return Length2(p - (a + ab * t));
+}
+
+// Douglas-Peucker on the points [first, last] of a contour: the farthest
+// point from the chord is kept while it lies beyond tolerance, and both sides
+// of it are simplified in turn.
+template <typename Point>
+void SimplifyPolyline(const Point &point, size_t first, size_t last,
+                      float tolerance2, uint8_t *kept) {
+  using Range = std::pair<size_t, size_t>;
+  struct Ranges;
+  std::vector<Range> &ranges = ScratchVector<Ranges, Range>();
+  ranges.assign(1, Range{first, last});
+  while (!ranges.empty()) {
+    const auto [a, b] = ranges.back();
+    ranges.pop_back();
+    float farthest = tolerance2;
+    size_t split = a;
+    for (size_t k = a + 1; k < b; ++k) {
+      const float d = PointToSegmentDistance2(point(k), point(a), point(b));
+      if (d > farthest) {
+        farthest = d;
+        split = k;
+      }
+    }
+    if (split != a) {
+      kept[split] = true;
+      ranges.push_back(Range{a, split});
+      ranges.push_back(Range{split, b});
+    }
+  }
 }
 } // namespace
 
 BBox CalculateBBox(const Mesh &mesh) {
-  BBox result;
-  for (const Vec3f v : mesh.vertices) {
-    result.Merge(v);
+  return mesh.box.IsValid()
+             ? mesh.box
+             : CalculateBBox(mesh.vertices.data(), mesh.vertices.size());
+}
+
+void WeldVertices(const Mesh &mesh, Mesh &result) {
+  TIME_BLOCK("Welding vertices")
+  assert(&mesh != &result);
+  const size_t verticesCount = mesh.vertices.size();
+  struct Order;
+  std::vector<uint32_t> &order = ScratchVector<Order, uint32_t>();
+  order.resize(verticesCount);
+  for (size_t i = 0; i < verticesCount; ++i) {
+    order[i] = i;
+  }
+  auto Less = [&](uint32_t a, uint32_t b) {
+    const Vec3f &pa = mesh.vertices[a];
+    const Vec3f &pb = mesh.vertices[b];
+    if (pa.x != pb.x)
+      return pa.x < pb.x;
+    if (pa.y != pb.y)
+      return pa.y < pb.y;
+    return pa.z < pb.z;
+  };
+  std::sort(order.begin(), order.end(), Less);
+
+  result.box = mesh.box;
+  result.name = mesh.name;
+  result.color = mesh.color;
+  result.id = mesh.id;
+  result.visible = mesh.visible;
+  result.vertices.clear();
+  struct Remap;
+  std::vector<uint32_t> &remap = ScratchVector<Remap, uint32_t>();
+  remap.resize(verticesCount);
+  for (size_t i = 0; i < verticesCount; ++i) {
+    const uint32_t v = order[i];
+    if (i == 0 || mesh.vertices[v] != result.vertices.back()) {
+      result.vertices.push_back(mesh.vertices[v]);
+    }
+    remap[v] = result.vertices.size() - 1;
   }
+
+  const int64_t facesCount = mesh.faces.size();
+  result.faces.resize(facesCount);
+#pragma omp parallel for
+  for (int64_t i = 0; i < facesCount; ++i) {
+    for (size_t j = 0; j < 3; ++j) {
+      result.faces[i][j] = remap[mesh.faces[i][j]];
+    }
+  }
+}
+
+Mesh WeldVertices(const Mesh &mesh) {
+  Mesh result;
+  WeldVertices(mesh, result);
   return result;
 }
 
-Connectivity BuildConnectivity(const Mesh &mesh) {
-  Connectivity c;
-  const size_t pointsCount = mesh.vertices.size();
-  c.pointCells.resize(pointsCount);
-  const size_t facesCount = mesh.faces.size();
-  for (size_t i = 0; i < facesCount; ++i) {
-    const Mesh::Triangle &f = mesh.faces[i];
-    c.pointCells[f[0]].adjacentFaces.insert(i);
-    c.pointCells[f[1]].adjacentFaces.insert(i);
-    c.pointCells[f[2]].adjacentFaces.insert(i);
+Mesh ChunkedMesh::Merge() const {
+  Mesh result;
+  size_t verticesCount = 0, facesCount = 0;
+  for (const Chunk &chunk : chunks) {
+    verticesCount += chunk.mesh.vertices.size();
+    facesCount += chunk.mesh.faces.size();
   }
+  result.vertices.reserve(verticesCount);
+  result.faces.reserve(facesCount);
+  for (const Chunk &chunk : chunks) {
+    const uint32_t offset = result.vertices.size();
+    result.vertices.insert(result.vertices.end(), chunk.mesh.vertices.begin(),
+                           chunk.mesh.vertices.end());
+    for (const Mesh::Triangle &t : chunk.mesh.faces) {
+      result.faces.push_back(
+          Mesh::Triangle{t[0] + offset, t[1] + offset, t[2] + offset});
+    }
+    if (!chunk.mesh.vertices.empty()) {
+      result.box.Merge(CalculateBBox(chunk.mesh));
+    }
+  }
+  result.id = GenerateID();
+  return result;
+}
+
+Connectivity BuildConnectivity(const Mesh &mesh, bool withNeighbours) {
+  Connectivity c;
+  BuildConnectivity(mesh, c, withNeighbours);
   return c;
 }
 
-std::vector<Vec3f> CalculateVertexNormals(const Mesh &mesh,
-                                          const Connectivity &connectivity) {
-  const std::vector<Vec3f> faceNormals = CalculateFacesNormals(mesh);
-  const size_t verticesCount = mesh.vertices.size();
-  std::vector<Vec3f> normals(verticesCount);
-  for (size_t i = 0; i < verticesCount; ++i) {
-    normals[i] = Vec3f{0.0, 0.0, 0.0};
-    for (const size_t faceIdx : connectivity.pointCells[i].adjacentFaces) {
-      normals[i] = normals[i] + faceNormals[faceIdx];
+void BuildConnectivity(const Mesh &mesh, Connectivity &c, bool withNeighbours) {
+  TIME_BLOCK("Connectivity")
+  const int64_t pointsCount = mesh.vertices.size();
+  const int64_t facesCount = mesh.faces.size();
+  // a degenerate face is listed once for its repeated vertex.
+  const auto IsRepeated = [](const Mesh::Triangle &f, size_t j) {
+    return (j > 0 && f[j] == f[0]) || (j == 2 && f[2] == f[1]);
+  };
+
+  // counting sort of the faces by vertex, the rows keep the faces order.
+  Adjacency &cells = c.pointCells;
+  FillRows(
+      facesCount, pointsCount,
+      [&](size_t i, const auto &emit) {
+        const Mesh::Triangle &f = mesh.faces[i];
+        for (size_t j = 0; j < 3; ++j) {
+          if (!IsRepeated(f, j)) {
+            emit(f[j]);
+          }
+        }
+      },
+      cells.offsets, cells.items);
+
+  if (!withNeighbours) {
+    c.pointNeighbours = Adjacency{};
+    return;
+  }
+  // the other two vertices of the faces around every vertex fill rows twice
+  // as long as the faces rows, which are then sorted and compacted.
+  Adjacency &neighbours = c.pointNeighbours;
+  neighbours.offsets.assign(pointsCount + 1, 0);
+  struct Items;
+  std::vector<uint32_t> &items = ScratchVector<Items, uint32_t>();
+  items.resize(2 * cells.items.size());
+#pragma omp parallel for schedule(dynamic, 1024)
+  for (int64_t i = 0; i < pointsCount; ++i) {
+    uint32_t *const row = items.data() + 2 * cells.offsets[i];
+    uint32_t *last = row;
+    for (const uint32_t face : cells[i]) {
+      for (const uint32_t n : mesh.faces[face]) {
+        if (n != uint32_t(i)) {
+          *last++ = n;
+        }
+      }
     }
-    const size_t adjecantFacesCount =
-        connectivity.pointCells[i].adjacentFaces.size();
-    normals[i] = normals[i] * (1.0 / adjecantFacesCount);
-    Normalise(normals[i]);
+    std::sort(row, last);
+    neighbours.offsets[i + 1] = std::unique(row, last) - row;
+  }
+  for (int64_t i = 0; i < pointsCount; ++i) {
+    neighbours.offsets[i + 1] += neighbours.offsets[i];
+  }
+  neighbours.items.resize(neighbours.offsets[pointsCount]);
+#pragma omp parallel for schedule(dynamic, 1024)
+  for (int64_t i = 0; i < pointsCount; ++i) {
+    const uint32_t *row = items.data() + 2 * cells.offsets[i];
+    std::copy(row, row + neighbours.offsets[i + 1] - neighbours.offsets[i],
+              neighbours.items.begin() + neighbours.offsets[i]);
   }
+}
+
+std::vector<Vec3f> CalculateVertexNormals(const Mesh &mesh) {
+  std::vector<Vec3f> normals;
+  CalculateVertexNormals(mesh, normals);
   return normals;
 }
 
+void CalculateVertexNormals(const Mesh &mesh, std::vector<Vec3f> &normals) {
+  TIME_BLOCK("Vertex normals")
+  const int64_t verticesCount = mesh.vertices.size();
+  normals.assign(verticesCount, Vec3f{0, 0, 0});
+  // the unnormalised face normals weight the faces by their area.
+  ParallelScatter(
+      mesh.faces.size(), normals,
+      [&](size_t i, const auto &emit) {
+        for (const uint32_t v : mesh.faces[i]) {
+          emit(v);
+        }
+      },
+      [&](size_t i, const auto &emit) {
+        const Mesh::Triangle &t = mesh.faces[i];
+        const Vec3f v0 = mesh.vertices[t[0]];
+        const Vec3f n =
+            CrossProduct(mesh.vertices[t[1]] - v0, mesh.vertices[t[2]] - v0);
+        for (const uint32_t v : t) {
+          emit(v, n);
+        }
+      },
+      [](Vec3f &normal, const Vec3f &n) { normal = normal + n; });
+#pragma omp parallel for
+  for (int64_t i = 0; i < verticesCount; ++i) {
+    Vec3f &n = normals[i];
+    const float length2 = n.x * n.x + n.y * n.y + n.z * n.z;
+    const float scale = length2 > 0 ? 1 / std::sqrt(length2) : 0;
+    n.x *= scale;
+    n.y *= scale;
+    n.z *= scale;
+  }
+}
+
 std::vector<Vec3f> CalculateFacesNormals(const Mesh &mesh) {
   std::vector<Vec3f> faceNormals;
   faceNormals.reserve(mesh.faces.size());
@@ -154,13 +1615,19 @@ void Slice(const Image3D &image, Orientation orientation, size_t index,
 
 Image3D CreateSDFGrid(const Cheese &cheese, const float min[3],
                       const float max[3], const float spacing[3]) {
+  Image3D image;
+  CreateSDFGrid(cheese, min, max, spacing, image);
+  return image;
+}
+
+void CreateSDFGrid(const Cheese &cheese, const float min[3],
+                   const float max[3], const float spacing[3], Image3D &image) {
   const size_t size[3] = {
       size_t((max[0] - min[0]) / spacing[0]) + 1,
       size_t((max[1] - min[1]) / spacing[1]) + 1,
       size_t((max[2] - min[2]) / spacing[2]) + 1,
   };
 
-  Image3D image;
   TIME_BLOCK("SDF generation")
   image.data.resize(size[0] * size[1] * size[2]);
   for (size_t i = 0; i < 3; i++) {
@@ -183,463 +1650,959 @@ Image3D CreateSDFGrid(const Cheese &cheese, const float min[3],
     }
   }
   image.UpdateMinMax();
-  return image;
+  CalculateBlocksRange(image, image.blocksRange);
+}
+
+BlocksRange CalculateBlocksRange(const Image3D &image) {
+  BlocksRange result;
+  CalculateBlocksRange(image, result);
+  return result;
+}
+
+void CalculateBlocksRange(const Image3D &image, BlocksRange &result) {
+  const CellBlocks cells(image);
+  for (size_t i = 0; i < 3; ++i) {
+    result.blocks[i] = cells.blocks[i];
+  }
+  const int64_t blocksCount = result.Count();
+  result.min.resize(blocksCount);
+  result.max.resize(blocksCount);
+
+#pragma omp parallel for
+  for (int64_t b = 0; b < blocksCount; ++b) {
+    UpdateBlockRange(image, cells, b, result);
+  }
 }
 
 Mesh MarchingCubes(const Image3D &image) {
-  constexpr int16_t edgeTable[256] = {
-      0x0,   0x109, 0x203, 0x30a, 0x406, 0x50f, 0x605, 0x70c, 0x80c, 0x905,
-      0xa0f, 0xb06, 0xc0a, 0xd03, 0xe09, 0xf00, 0x190, 0x99,  0x393, 0x29a,
-      0x596, 0x49f, 0x795, 0x69c, 0x99c, 0x895, 0xb9f, 0xa96, 0xd9a, 0xc93,
-      0xf99, 0xe90, 0x230, 0x339, 0x33,  0x13a, 0x636, 0x73f, 0x435, 0x53c,
-      0xa3c, 0xb35, 0x83f, 0x936, 0xe3a, 0xf33, 0xc39, 0xd30, 0x3a0, 0x2a9,
-      0x1a3, 0xaa,  0x7a6, 0x6af, 0x5a5, 0x4ac, 0xbac, 0xaa5, 0x9af, 0x8a6,
-      0xfaa, 0xea3, 0xda9, 0xca0, 0x460, 0x569, 0x663, 0x76a, 0x66,  0x16f,
-      0x265, 0x36c, 0xc6c, 0xd65, 0xe6f, 0xf66, 0x86a, 0x963, 0xa69, 0xb60,
-      0x5f0, 0x4f9, 0x7f3, 0x6fa, 0x1f6, 0xff,  0x3f5, 0x2fc, 0xdfc, 0xcf5,
-      0xfff, 0xef6, 0x9fa, 0x8f3, 0xbf9, 0xaf0, 0x650, 0x759, 0x453, 0x55a,
-      0x256, 0x35f, 0x55,  0x15c, 0xe5c, 0xf55, 0xc5f, 0xd56, 0xa5a, 0xb53,
-      0x859, 0x950, 0x7c0, 0x6c9, 0x5c3, 0x4ca, 0x3c6, 0x2cf, 0x1c5, 0xcc,
-      0xfcc, 0xec5, 0xdcf, 0xcc6, 0xbca, 0xac3, 0x9c9, 0x8c0, 0x8c0, 0x9c9,
-      0xac3, 0xbca, 0xcc6, 0xdcf, 0xec5, 0xfcc, 0xcc,  0x1c5, 0x2cf, 0x3c6,
-      0x4ca, 0x5c3, 0x6c9, 0x7c0, 0x950, 0x859, 0xb53, 0xa5a, 0xd56, 0xc5f,
-      0xf55, 0xe5c, 0x15c, 0x55,  0x35f, 0x256, 0x55a, 0x453, 0x759, 0x650,
-      0xaf0, 0xbf9, 0x8f3, 0x9fa, 0xef6, 0xfff, 0xcf5, 0xdfc, 0x2fc, 0x3f5,
-      0xff,  0x1f6, 0x6fa, 0x7f3, 0x4f9, 0x5f0, 0xb60, 0xa69, 0x963, 0x86a,
-      0xf66, 0xe6f, 0xd65, 0xc6c, 0x36c, 0x265, 0x16f, 0x66,  0x76a, 0x663,
-      0x569, 0x460, 0xca0, 0xda9, 0xea3, 0xfaa, 0x8a6, 0x9af, 0xaa5, 0xbac,
-      0x4ac, 0x5a5, 0x6af, 0x7a6, 0xaa,  0x1a3, 0x2a9, 0x3a0, 0xd30, 0xc39,
-      0xf33, 0xe3a, 0x936, 0x83f, 0xb35, 0xa3c, 0x53c, 0x435, 0x73f, 0x636,
-      0x13a, 0x33,  0x339, 0x230, 0xe90, 0xf99, 0xc93, 0xd9a, 0xa96, 0xb9f,
-      0x895, 0x99c, 0x69c, 0x795, 0x49f, 0x596, 0x29a, 0x393, 0x99,  0x190,
-      0xf00, 0xe09, 0xd03, 0xc0a, 0xb06, 0xa0f, 0x905, 0x80c, 0x70c, 0x605,
-      0x50f, 0x406, 0x30a, 0x203, 0x109, 0x0};
-  constexpr int8_t triTable[256][16] = {
-      {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {0, 8, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {0, 1, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {1, 8, 3, 9, 8, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {1, 2, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {0, 8, 3, 1, 2, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {9, 2, 10, 0, 2, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {2, 8, 3, 2, 10, 8, 10, 9, 8, -1, -1, -1, -1, -1, -1, -1},
-      {3, 11, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {0, 11, 2, 8, 11, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {1, 9, 0, 2, 3, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {1, 11, 2, 1, 9, 11, 9, 8, 11, -1, -1, -1, -1, -1, -1, -1},
-      {3, 10, 1, 11, 10, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {0, 10, 1, 0, 8, 10, 8, 11, 10, -1, -1, -1, -1, -1, -1, -1},
-      {3, 9, 0, 3, 11, 9, 11, 10, 9, -1, -1, -1, -1, -1, -1, -1},
-      {9, 8, 10, 10, 8, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {4, 7, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {4, 3, 0, 7, 3, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {0, 1, 9, 8, 4, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {4, 1, 9, 4, 7, 1, 7, 3, 1, -1, -1, -1, -1, -1, -1, -1},
-      {1, 2, 10, 8, 4, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {3, 4, 7, 3, 0, 4, 1, 2, 10, -1, -1, -1, -1, -1, -1, -1},
-      {9, 2, 10, 9, 0, 2, 8, 4, 7, -1, -1, -1, -1, -1, -1, -1},
-      {2, 10, 9, 2, 9, 7, 2, 7, 3, 7, 9, 4, -1, -1, -1, -1},
-      {8, 4, 7, 3, 11, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {11, 4, 7, 11, 2, 4, 2, 0, 4, -1, -1, -1, -1, -1, -1, -1},
-      {9, 0, 1, 8, 4, 7, 2, 3, 11, -1, -1, -1, -1, -1, -1, -1},
-      {4, 7, 11, 9, 4, 11, 9, 11, 2, 9, 2, 1, -1, -1, -1, -1},
-      {3, 10, 1, 3, 11, 10, 7, 8, 4, -1, -1, -1, -1, -1, -1, -1},
-      {1, 11, 10, 1, 4, 11, 1, 0, 4, 7, 11, 4, -1, -1, -1, -1},
-      {4, 7, 8, 9, 0, 11, 9, 11, 10, 11, 0, 3, -1, -1, -1, -1},
-      {4, 7, 11, 4, 11, 9, 9, 11, 10, -1, -1, -1, -1, -1, -1, -1},
-      {9, 5, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {9, 5, 4, 0, 8, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {0, 5, 4, 1, 5, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {8, 5, 4, 8, 3, 5, 3, 1, 5, -1, -1, -1, -1, -1, -1, -1},
-      {1, 2, 10, 9, 5, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {3, 0, 8, 1, 2, 10, 4, 9, 5, -1, -1, -1, -1, -1, -1, -1},
-      {5, 2, 10, 5, 4, 2, 4, 0, 2, -1, -1, -1, -1, -1, -1, -1},
-      {2, 10, 5, 3, 2, 5, 3, 5, 4, 3, 4, 8, -1, -1, -1, -1},
-      {9, 5, 4, 2, 3, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {0, 11, 2, 0, 8, 11, 4, 9, 5, -1, -1, -1, -1, -1, -1, -1},
-      {0, 5, 4, 0, 1, 5, 2, 3, 11, -1, -1, -1, -1, -1, -1, -1},
-      {2, 1, 5, 2, 5, 8, 2, 8, 11, 4, 8, 5, -1, -1, -1, -1},
-      {10, 3, 11, 10, 1, 3, 9, 5, 4, -1, -1, -1, -1, -1, -1, -1},
-      {4, 9, 5, 0, 8, 1, 8, 10, 1, 8, 11, 10, -1, -1, -1, -1},
-      {5, 4, 0, 5, 0, 11, 5, 11, 10, 11, 0, 3, -1, -1, -1, -1},
-      {5, 4, 8, 5, 8, 10, 10, 8, 11, -1, -1, -1, -1, -1, -1, -1},
-      {9, 7, 8, 5, 7, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {9, 3, 0, 9, 5, 3, 5, 7, 3, -1, -1, -1, -1, -1, -1, -1},
-      {0, 7, 8, 0, 1, 7, 1, 5, 7, -1, -1, -1, -1, -1, -1, -1},
-      {1, 5, 3, 3, 5, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {9, 7, 8, 9, 5, 7, 10, 1, 2, -1, -1, -1, -1, -1, -1, -1},
-      {10, 1, 2, 9, 5, 0, 5, 3, 0, 5, 7, 3, -1, -1, -1, -1},
-      {8, 0, 2, 8, 2, 5, 8, 5, 7, 10, 5, 2, -1, -1, -1, -1},
-      {2, 10, 5, 2, 5, 3, 3, 5, 7, -1, -1, -1, -1, -1, -1, -1},
-      {7, 9, 5, 7, 8, 9, 3, 11, 2, -1, -1, -1, -1, -1, -1, -1},
-      {9, 5, 7, 9, 7, 2, 9, 2, 0, 2, 7, 11, -1, -1, -1, -1},
-      {2, 3, 11, 0, 1, 8, 1, 7, 8, 1, 5, 7, -1, -1, -1, -1},
-      {11, 2, 1, 11, 1, 7, 7, 1, 5, -1, -1, -1, -1, -1, -1, -1},
-      {9, 5, 8, 8, 5, 7, 10, 1, 3, 10, 3, 11, -1, -1, -1, -1},
-      {5, 7, 0, 5, 0, 9, 7, 11, 0, 1, 0, 10, 11, 10, 0, -1},
-      {11, 10, 0, 11, 0, 3, 10, 5, 0, 8, 0, 7, 5, 7, 0, -1},
-      {11, 10, 5, 7, 11, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {10, 6, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {0, 8, 3, 5, 10, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {9, 0, 1, 5, 10, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {1, 8, 3, 1, 9, 8, 5, 10, 6, -1, -1, -1, -1, -1, -1, -1},
-      {1, 6, 5, 2, 6, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {1, 6, 5, 1, 2, 6, 3, 0, 8, -1, -1, -1, -1, -1, -1, -1},
-      {9, 6, 5, 9, 0, 6, 0, 2, 6, -1, -1, -1, -1, -1, -1, -1},
-      {5, 9, 8, 5, 8, 2, 5, 2, 6, 3, 2, 8, -1, -1, -1, -1},
-      {2, 3, 11, 10, 6, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {11, 0, 8, 11, 2, 0, 10, 6, 5, -1, -1, -1, -1, -1, -1, -1},
-      {0, 1, 9, 2, 3, 11, 5, 10, 6, -1, -1, -1, -1, -1, -1, -1},
-      {5, 10, 6, 1, 9, 2, 9, 11, 2, 9, 8, 11, -1, -1, -1, -1},
-      {6, 3, 11, 6, 5, 3, 5, 1, 3, -1, -1, -1, -1, -1, -1, -1},
-      {0, 8, 11, 0, 11, 5, 0, 5, 1, 5, 11, 6, -1, -1, -1, -1},
-      {3, 11, 6, 0, 3, 6, 0, 6, 5, 0, 5, 9, -1, -1, -1, -1},
-      {6, 5, 9, 6, 9, 11, 11, 9, 8, -1, -1, -1, -1, -1, -1, -1},
-      {5, 10, 6, 4, 7, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {4, 3, 0, 4, 7, 3, 6, 5, 10, -1, -1, -1, -1, -1, -1, -1},
-      {1, 9, 0, 5, 10, 6, 8, 4, 7, -1, -1, -1, -1, -1, -1, -1},
-      {10, 6, 5, 1, 9, 7, 1, 7, 3, 7, 9, 4, -1, -1, -1, -1},
-      {6, 1, 2, 6, 5, 1, 4, 7, 8, -1, -1, -1, -1, -1, -1, -1},
-      {1, 2, 5, 5, 2, 6, 3, 0, 4, 3, 4, 7, -1, -1, -1, -1},
-      {8, 4, 7, 9, 0, 5, 0, 6, 5, 0, 2, 6, -1, -1, -1, -1},
-      {7, 3, 9, 7, 9, 4, 3, 2, 9, 5, 9, 6, 2, 6, 9, -1},
-      {3, 11, 2, 7, 8, 4, 10, 6, 5, -1, -1, -1, -1, -1, -1, -1},
-      {5, 10, 6, 4, 7, 2, 4, 2, 0, 2, 7, 11, -1, -1, -1, -1},
-      {0, 1, 9, 4, 7, 8, 2, 3, 11, 5, 10, 6, -1, -1, -1, -1},
-      {9, 2, 1, 9, 11, 2, 9, 4, 11, 7, 11, 4, 5, 10, 6, -1},
-      {8, 4, 7, 3, 11, 5, 3, 5, 1, 5, 11, 6, -1, -1, -1, -1},
-      {5, 1, 11, 5, 11, 6, 1, 0, 11, 7, 11, 4, 0, 4, 11, -1},
-      {0, 5, 9, 0, 6, 5, 0, 3, 6, 11, 6, 3, 8, 4, 7, -1},
-      {6, 5, 9, 6, 9, 11, 4, 7, 9, 7, 11, 9, -1, -1, -1, -1},
-      {10, 4, 9, 6, 4, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {4, 10, 6, 4, 9, 10, 0, 8, 3, -1, -1, -1, -1, -1, -1, -1},
-      {10, 0, 1, 10, 6, 0, 6, 4, 0, -1, -1, -1, -1, -1, -1, -1},
-      {8, 3, 1, 8, 1, 6, 8, 6, 4, 6, 1, 10, -1, -1, -1, -1},
-      {1, 4, 9, 1, 2, 4, 2, 6, 4, -1, -1, -1, -1, -1, -1, -1},
-      {3, 0, 8, 1, 2, 9, 2, 4, 9, 2, 6, 4, -1, -1, -1, -1},
-      {0, 2, 4, 4, 2, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {8, 3, 2, 8, 2, 4, 4, 2, 6, -1, -1, -1, -1, -1, -1, -1},
-      {10, 4, 9, 10, 6, 4, 11, 2, 3, -1, -1, -1, -1, -1, -1, -1},
-      {0, 8, 2, 2, 8, 11, 4, 9, 10, 4, 10, 6, -1, -1, -1, -1},
-      {3, 11, 2, 0, 1, 6, 0, 6, 4, 6, 1, 10, -1, -1, -1, -1},
-      {6, 4, 1, 6, 1, 10, 4, 8, 1, 2, 1, 11, 8, 11, 1, -1},
-      {9, 6, 4, 9, 3, 6, 9, 1, 3, 11, 6, 3, -1, -1, -1, -1},
-      {8, 11, 1, 8, 1, 0, 11, 6, 1, 9, 1, 4, 6, 4, 1, -1},
-      {3, 11, 6, 3, 6, 0, 0, 6, 4, -1, -1, -1, -1, -1, -1, -1},
-      {6, 4, 8, 11, 6, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {7, 10, 6, 7, 8, 10, 8, 9, 10, -1, -1, -1, -1, -1, -1, -1},
-      {0, 7, 3, 0, 10, 7, 0, 9, 10, 6, 7, 10, -1, -1, -1, -1},
-      {10, 6, 7, 1, 10, 7, 1, 7, 8, 1, 8, 0, -1, -1, -1, -1},
-      {10, 6, 7, 10, 7, 1, 1, 7, 3, -1, -1, -1, -1, -1, -1, -1},
-      {1, 2, 6, 1, 6, 8, 1, 8, 9, 8, 6, 7, -1, -1, -1, -1},
-      {2, 6, 9, 2, 9, 1, 6, 7, 9, 0, 9, 3, 7, 3, 9, -1},
-      {7, 8, 0, 7, 0, 6, 6, 0, 2, -1, -1, -1, -1, -1, -1, -1},
-      {7, 3, 2, 6, 7, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {2, 3, 11, 10, 6, 8, 10, 8, 9, 8, 6, 7, -1, -1, -1, -1},
-      {2, 0, 7, 2, 7, 11, 0, 9, 7, 6, 7, 10, 9, 10, 7, -1},
-      {1, 8, 0, 1, 7, 8, 1, 10, 7, 6, 7, 10, 2, 3, 11, -1},
-      {11, 2, 1, 11, 1, 7, 10, 6, 1, 6, 7, 1, -1, -1, -1, -1},
-      {8, 9, 6, 8, 6, 7, 9, 1, 6, 11, 6, 3, 1, 3, 6, -1},
-      {0, 9, 1, 11, 6, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {7, 8, 0, 7, 0, 6, 3, 11, 0, 11, 6, 0, -1, -1, -1, -1},
-      {7, 11, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {7, 6, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {3, 0, 8, 11, 7, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {0, 1, 9, 11, 7, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {8, 1, 9, 8, 3, 1, 11, 7, 6, -1, -1, -1, -1, -1, -1, -1},
-      {10, 1, 2, 6, 11, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {1, 2, 10, 3, 0, 8, 6, 11, 7, -1, -1, -1, -1, -1, -1, -1},
-      {2, 9, 0, 2, 10, 9, 6, 11, 7, -1, -1, -1, -1, -1, -1, -1},
-      {6, 11, 7, 2, 10, 3, 10, 8, 3, 10, 9, 8, -1, -1, -1, -1},
-      {7, 2, 3, 6, 2, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {7, 0, 8, 7, 6, 0, 6, 2, 0, -1, -1, -1, -1, -1, -1, -1},
-      {2, 7, 6, 2, 3, 7, 0, 1, 9, -1, -1, -1, -1, -1, -1, -1},
-      {1, 6, 2, 1, 8, 6, 1, 9, 8, 8, 7, 6, -1, -1, -1, -1},
-      {10, 7, 6, 10, 1, 7, 1, 3, 7, -1, -1, -1, -1, -1, -1, -1},
-      {10, 7, 6, 1, 7, 10, 1, 8, 7, 1, 0, 8, -1, -1, -1, -1},
-      {0, 3, 7, 0, 7, 10, 0, 10, 9, 6, 10, 7, -1, -1, -1, -1},
-      {7, 6, 10, 7, 10, 8, 8, 10, 9, -1, -1, -1, -1, -1, -1, -1},
-      {6, 8, 4, 11, 8, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {3, 6, 11, 3, 0, 6, 0, 4, 6, -1, -1, -1, -1, -1, -1, -1},
-      {8, 6, 11, 8, 4, 6, 9, 0, 1, -1, -1, -1, -1, -1, -1, -1},
-      {9, 4, 6, 9, 6, 3, 9, 3, 1, 11, 3, 6, -1, -1, -1, -1},
-      {6, 8, 4, 6, 11, 8, 2, 10, 1, -1, -1, -1, -1, -1, -1, -1},
-      {1, 2, 10, 3, 0, 11, 0, 6, 11, 0, 4, 6, -1, -1, -1, -1},
-      {4, 11, 8, 4, 6, 11, 0, 2, 9, 2, 10, 9, -1, -1, -1, -1},
-      {10, 9, 3, 10, 3, 2, 9, 4, 3, 11, 3, 6, 4, 6, 3, -1},
-      {8, 2, 3, 8, 4, 2, 4, 6, 2, -1, -1, -1, -1, -1, -1, -1},
-      {0, 4, 2, 4, 6, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {1, 9, 0, 2, 3, 4, 2, 4, 6, 4, 3, 8, -1, -1, -1, -1},
-      {1, 9, 4, 1, 4, 2, 2, 4, 6, -1, -1, -1, -1, -1, -1, -1},
-      {8, 1, 3, 8, 6, 1, 8, 4, 6, 6, 10, 1, -1, -1, -1, -1},
-      {10, 1, 0, 10, 0, 6, 6, 0, 4, -1, -1, -1, -1, -1, -1, -1},
-      {4, 6, 3, 4, 3, 8, 6, 10, 3, 0, 3, 9, 10, 9, 3, -1},
-      {10, 9, 4, 6, 10, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {4, 9, 5, 7, 6, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {0, 8, 3, 4, 9, 5, 11, 7, 6, -1, -1, -1, -1, -1, -1, -1},
-      {5, 0, 1, 5, 4, 0, 7, 6, 11, -1, -1, -1, -1, -1, -1, -1},
-      {11, 7, 6, 8, 3, 4, 3, 5, 4, 3, 1, 5, -1, -1, -1, -1},
-      {9, 5, 4, 10, 1, 2, 7, 6, 11, -1, -1, -1, -1, -1, -1, -1},
-      {6, 11, 7, 1, 2, 10, 0, 8, 3, 4, 9, 5, -1, -1, -1, -1},
-      {7, 6, 11, 5, 4, 10, 4, 2, 10, 4, 0, 2, -1, -1, -1, -1},
-      {3, 4, 8, 3, 5, 4, 3, 2, 5, 10, 5, 2, 11, 7, 6, -1},
-      {7, 2, 3, 7, 6, 2, 5, 4, 9, -1, -1, -1, -1, -1, -1, -1},
-      {9, 5, 4, 0, 8, 6, 0, 6, 2, 6, 8, 7, -1, -1, -1, -1},
-      {3, 6, 2, 3, 7, 6, 1, 5, 0, 5, 4, 0, -1, -1, -1, -1},
-      {6, 2, 8, 6, 8, 7, 2, 1, 8, 4, 8, 5, 1, 5, 8, -1},
-      {9, 5, 4, 10, 1, 6, 1, 7, 6, 1, 3, 7, -1, -1, -1, -1},
-      {1, 6, 10, 1, 7, 6, 1, 0, 7, 8, 7, 0, 9, 5, 4, -1},
-      {4, 0, 10, 4, 10, 5, 0, 3, 10, 6, 10, 7, 3, 7, 10, -1},
-      {7, 6, 10, 7, 10, 8, 5, 4, 10, 4, 8, 10, -1, -1, -1, -1},
-      {6, 9, 5, 6, 11, 9, 11, 8, 9, -1, -1, -1, -1, -1, -1, -1},
-      {3, 6, 11, 0, 6, 3, 0, 5, 6, 0, 9, 5, -1, -1, -1, -1},
-      {0, 11, 8, 0, 5, 11, 0, 1, 5, 5, 6, 11, -1, -1, -1, -1},
-      {6, 11, 3, 6, 3, 5, 5, 3, 1, -1, -1, -1, -1, -1, -1, -1},
-      {1, 2, 10, 9, 5, 11, 9, 11, 8, 11, 5, 6, -1, -1, -1, -1},
-      {0, 11, 3, 0, 6, 11, 0, 9, 6, 5, 6, 9, 1, 2, 10, -1},
-      {11, 8, 5, 11, 5, 6, 8, 0, 5, 10, 5, 2, 0, 2, 5, -1},
-      {6, 11, 3, 6, 3, 5, 2, 10, 3, 10, 5, 3, -1, -1, -1, -1},
-      {5, 8, 9, 5, 2, 8, 5, 6, 2, 3, 8, 2, -1, -1, -1, -1},
-      {9, 5, 6, 9, 6, 0, 0, 6, 2, -1, -1, -1, -1, -1, -1, -1},
-      {1, 5, 8, 1, 8, 0, 5, 6, 8, 3, 8, 2, 6, 2, 8, -1},
-      {1, 5, 6, 2, 1, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {1, 3, 6, 1, 6, 10, 3, 8, 6, 5, 6, 9, 8, 9, 6, -1},
-      {10, 1, 0, 10, 0, 6, 9, 5, 0, 5, 6, 0, -1, -1, -1, -1},
-      {0, 3, 8, 5, 6, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {10, 5, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {11, 5, 10, 7, 5, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {11, 5, 10, 11, 7, 5, 8, 3, 0, -1, -1, -1, -1, -1, -1, -1},
-      {5, 11, 7, 5, 10, 11, 1, 9, 0, -1, -1, -1, -1, -1, -1, -1},
-      {10, 7, 5, 10, 11, 7, 9, 8, 1, 8, 3, 1, -1, -1, -1, -1},
-      {11, 1, 2, 11, 7, 1, 7, 5, 1, -1, -1, -1, -1, -1, -1, -1},
-      {0, 8, 3, 1, 2, 7, 1, 7, 5, 7, 2, 11, -1, -1, -1, -1},
-      {9, 7, 5, 9, 2, 7, 9, 0, 2, 2, 11, 7, -1, -1, -1, -1},
-      {7, 5, 2, 7, 2, 11, 5, 9, 2, 3, 2, 8, 9, 8, 2, -1},
-      {2, 5, 10, 2, 3, 5, 3, 7, 5, -1, -1, -1, -1, -1, -1, -1},
-      {8, 2, 0, 8, 5, 2, 8, 7, 5, 10, 2, 5, -1, -1, -1, -1},
-      {9, 0, 1, 5, 10, 3, 5, 3, 7, 3, 10, 2, -1, -1, -1, -1},
-      {9, 8, 2, 9, 2, 1, 8, 7, 2, 10, 2, 5, 7, 5, 2, -1},
-      {1, 3, 5, 3, 7, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {0, 8, 7, 0, 7, 1, 1, 7, 5, -1, -1, -1, -1, -1, -1, -1},
-      {9, 0, 3, 9, 3, 5, 5, 3, 7, -1, -1, -1, -1, -1, -1, -1},
-      {9, 8, 7, 5, 9, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {5, 8, 4, 5, 10, 8, 10, 11, 8, -1, -1, -1, -1, -1, -1, -1},
-      {5, 0, 4, 5, 11, 0, 5, 10, 11, 11, 3, 0, -1, -1, -1, -1},
-      {0, 1, 9, 8, 4, 10, 8, 10, 11, 10, 4, 5, -1, -1, -1, -1},
-      {10, 11, 4, 10, 4, 5, 11, 3, 4, 9, 4, 1, 3, 1, 4, -1},
-      {2, 5, 1, 2, 8, 5, 2, 11, 8, 4, 5, 8, -1, -1, -1, -1},
-      {0, 4, 11, 0, 11, 3, 4, 5, 11, 2, 11, 1, 5, 1, 11, -1},
-      {0, 2, 5, 0, 5, 9, 2, 11, 5, 4, 5, 8, 11, 8, 5, -1},
-      {9, 4, 5, 2, 11, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {2, 5, 10, 3, 5, 2, 3, 4, 5, 3, 8, 4, -1, -1, -1, -1},
-      {5, 10, 2, 5, 2, 4, 4, 2, 0, -1, -1, -1, -1, -1, -1, -1},
-      {3, 10, 2, 3, 5, 10, 3, 8, 5, 4, 5, 8, 0, 1, 9, -1},
-      {5, 10, 2, 5, 2, 4, 1, 9, 2, 9, 4, 2, -1, -1, -1, -1},
-      {8, 4, 5, 8, 5, 3, 3, 5, 1, -1, -1, -1, -1, -1, -1, -1},
-      {0, 4, 5, 1, 0, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {8, 4, 5, 8, 5, 3, 9, 0, 5, 0, 3, 5, -1, -1, -1, -1},
-      {9, 4, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {4, 11, 7, 4, 9, 11, 9, 10, 11, -1, -1, -1, -1, -1, -1, -1},
-      {0, 8, 3, 4, 9, 7, 9, 11, 7, 9, 10, 11, -1, -1, -1, -1},
-      {1, 10, 11, 1, 11, 4, 1, 4, 0, 7, 4, 11, -1, -1, -1, -1},
-      {3, 1, 4, 3, 4, 8, 1, 10, 4, 7, 4, 11, 10, 11, 4, -1},
-      {4, 11, 7, 9, 11, 4, 9, 2, 11, 9, 1, 2, -1, -1, -1, -1},
-      {9, 7, 4, 9, 11, 7, 9, 1, 11, 2, 11, 1, 0, 8, 3, -1},
-      {11, 7, 4, 11, 4, 2, 2, 4, 0, -1, -1, -1, -1, -1, -1, -1},
-      {11, 7, 4, 11, 4, 2, 8, 3, 4, 3, 2, 4, -1, -1, -1, -1},
-      {2, 9, 10, 2, 7, 9, 2, 3, 7, 7, 4, 9, -1, -1, -1, -1},
-      {9, 10, 7, 9, 7, 4, 10, 2, 7, 8, 7, 0, 2, 0, 7, -1},
-      {3, 7, 10, 3, 10, 2, 7, 4, 10, 1, 10, 0, 4, 0, 10, -1},
-      {1, 10, 2, 8, 7, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {4, 9, 1, 4, 1, 7, 7, 1, 3, -1, -1, -1, -1, -1, -1, -1},
-      {4, 9, 1, 4, 1, 7, 0, 8, 1, 8, 7, 1, -1, -1, -1, -1},
-      {4, 0, 3, 7, 4, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {4, 8, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {9, 10, 8, 10, 11, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {3, 0, 9, 3, 9, 11, 11, 9, 10, -1, -1, -1, -1, -1, -1, -1},
-      {0, 1, 10, 0, 10, 8, 8, 10, 11, -1, -1, -1, -1, -1, -1, -1},
-      {3, 1, 10, 11, 3, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {1, 2, 11, 1, 11, 9, 9, 11, 8, -1, -1, -1, -1, -1, -1, -1},
-      {3, 0, 9, 3, 9, 11, 1, 2, 9, 2, 11, 9, -1, -1, -1, -1},
-      {0, 2, 11, 8, 0, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {3, 2, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {2, 3, 8, 2, 8, 10, 10, 8, 9, -1, -1, -1, -1, -1, -1, -1},
-      {9, 10, 2, 0, 9, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {2, 3, 8, 2, 8, 10, 0, 1, 8, 1, 10, 8, -1, -1, -1, -1},
-      {1, 10, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {1, 3, 8, 9, 1, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {0, 9, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {0, 3, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-      {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1}};
+  Mesh mesh;
+  MarchingCubes(image, mesh);
+  return mesh;
+}
+
+void MarchingCubes(const Image3D &image, Mesh &mesh) {
   const float isolevel = 0;
   const Color YELLOW{255, 255, 0, 255};
-  Mesh mesh;
   mesh.id = GenerateID();
   mesh.color = YELLOW;
   mesh.visible = true;
 
   TIME_BLOCK("Mesh generation")
 
-  struct Grid {
-    Vec3f p[8] = {};
-    float val[8] = {};
+  const CellBlocks blocks(image);
+  struct Active;
+  std::vector<size_t> &activeBlocks = ScratchVector<Active, size_t>();
+  ActiveBlocks(image, blocks, isolevel, activeBlocks);
+  PolygoniseBlocks(image, blocks, activeBlocks, isolevel, mesh);
+}
+
+ChunkedMesh MarchingCubesChunks(const Image3D &image) {
+  const float isolevel = 0;
+  TIME_BLOCK("Chunked mesh generation")
+  const CellBlocks blocks(image);
+  const bool hasBlocksRange = image.blocksRange.min.size() == blocks.Count();
+  const BlocksRange blocksRange =
+      hasBlocksRange ? BlocksRange{} : CalculateBlocksRange(image);
+  const BlocksRange &range = hasBlocksRange ? image.blocksRange : blocksRange;
+  constexpr size_t N = ChunkedMesh::CHUNK_BLOCKS;
+  ChunkedMesh result;
+  for (size_t i = 0; i < 3; ++i) {
+    result.size[i] = (blocks.blocks[i] + N - 1) / N;
+  }
+  result.chunks.resize(result.size[0] * result.size[1] * result.size[2]);
+  for (size_t z = 0; z < result.size[2]; ++z) {
+    for (size_t y = 0; y < result.size[1]; ++y) {
+      for (size_t x = 0; x < result.size[0]; ++x) {
+        ChunkedMesh::Chunk &chunk = result.chunks[result.LinearIndex(x, y, z)];
+        const size_t index[3] = {x, y, z};
+        for (size_t i = 0; i < 3; ++i) {
+          const size_t cellsBegin = index[i] * N * CellBlocks::BLOCK_SIZE;
+          const size_t cellsEnd = (std::min)(
+              cellsBegin + N * CellBlocks::BLOCK_SIZE, blocks.cells[i]);
+          chunk.box.min[i] = image.origin[i] + cellsBegin * image.spacing[i];
+          chunk.box.max[i] = image.origin[i] + cellsEnd * image.spacing[i];
+        }
+        PolygoniseChunk(image, blocks, range, x, y, z, chunk.lod,
+                        chunk.transitions, isolevel, chunk.mesh);
+        chunk.dirty = true;
+      }
+    }
+  }
+  return result;
+}
+
+void UpdateRegion(const Cheese &cheese, const BBox &region, Image3D &image,
+                  ChunkedMesh &mesh) {
+  const float isolevel = 0;
+  TIME_BLOCK("Region update")
+  const CellBlocks blocks(image);
+  if (image.blocksRange.min.size() != blocks.Count()) {
+    image.blocksRange = CalculateBlocksRange(image);
+  }
+
+  // the blocks whose cells use the samples inside the region.
+  std::vector<size_t> frontier;
+  std::vector<uint8_t> visited(blocks.Count(), 0);
+  {
+    size_t lo[3], hi[3];
+    for (size_t i = 0; i < 3; ++i) {
+      const float l = (region.min[i] - image.origin[i]) / image.spacing[i];
+      const float h = (region.max[i] - image.origin[i]) / image.spacing[i];
+      if (blocks.cells[i] == 0 || h < 0 || l > blocks.cells[i]) {
+        return;
+      }
+      const size_t cellLo = l > 1 ? size_t(l) - 1 : 0;
+      const size_t cellHi = (std::min)(size_t(h), blocks.cells[i] - 1);
+      lo[i] = cellLo / CellBlocks::BLOCK_SIZE;
+      hi[i] = cellHi / CellBlocks::BLOCK_SIZE;
+    }
+    for (size_t z = lo[2]; z <= hi[2]; ++z) {
+      for (size_t y = lo[1]; y <= hi[1]; ++y) {
+        for (size_t x = lo[0]; x <= hi[0]; ++x) {
+          const size_t b = blocks.LinearIndex(x, y, z);
+          visited[b] = 1;
+          frontier.push_back(b);
+        }
+      }
+    }
+  }
+
+  // The squared distances of the cheese make an edit change values far from
+  // the edited region, so the update grows through the neighbour blocks for
+  // as long as their samples change.
+  std::vector<size_t> updated;
+  std::vector<uint8_t> changed;
+  float min = image.min;
+  float max = image.max;
+  while (!frontier.empty()) {
+    const int64_t frontierCount = frontier.size();
+    changed.assign(frontierCount, 0);
+#pragma omp parallel for schedule(dynamic) reduction(min : min) \
+    reduction(max : max)
+    for (int64_t k = 0; k < frontierCount; ++k) {
+      // every block owns the samples at the start of its cells, the last
+      // blocks also own the samples closing the grid.
+      size_t begin[3], end[3];
+      blocks.Range(frontier[k], begin, end);
+      for (size_t i = 0; i < 3; ++i) {
+        end[i] += end[i] == blocks.cells[i];
+      }
+      for (size_t z = begin[2]; z < end[2]; z++) {
+        for (size_t y = begin[1]; y < end[1]; y++) {
+          for (size_t x = begin[0]; x < end[0]; x++) {
+            const float v = cheese.Eval(image.origin[0] + image.spacing[0] * x,
+                                        image.origin[1] + image.spacing[1] * y,
+                                        image.origin[2] + image.spacing[2] * z);
+            float &sample = image.At(x, y, z);
+            if (sample != v) {
+              sample = v;
+              changed[k] = 1;
+              min = (std::min)(min, v);
+              max = (std::max)(max, v);
+            }
+          }
+        }
+      }
+    }
+
+    std::vector<size_t> next;
+    for (int64_t k = 0; k < frontierCount; ++k) {
+      updated.push_back(frontier[k]);
+      if (!changed[k]) {
+        continue;
+      }
+      size_t index[3];
+      blocks.Index(frontier[k], index);
+      for (int64_t dz = -1; dz <= 1; ++dz) {
+        for (int64_t dy = -1; dy <= 1; ++dy) {
+          for (int64_t dx = -1; dx <= 1; ++dx) {
+            const int64_t n[3] = {int64_t(index[0]) + dx,
+                                  int64_t(index[1]) + dy,
+                                  int64_t(index[2]) + dz};
+            if (n[0] < 0 || n[1] < 0 || n[2] < 0 ||
+                n[0] >= int64_t(blocks.blocks[0]) ||
+                n[1] >= int64_t(blocks.blocks[1]) ||
+                n[2] >= int64_t(blocks.blocks[2])) {
+              continue;
+            }
+            const size_t b = blocks.LinearIndex(n[0], n[1], n[2]);
+            if (!visited[b]) {
+              visited[b] = 1;
+              next.push_back(b);
+            }
+          }
+        }
+      }
+    }
+    frontier = std::move(next);
+  }
+  // the global range can only be widened without a full pass.
+  image.min = min;
+  image.max = max;
+
+  // the blocks next to a changed block are updated too, so every block
+  // using a changed sample is in the updated list.
+  const int64_t updatedCount = updated.size();
+#pragma omp parallel for
+  for (int64_t k = 0; k < updatedCount; ++k) {
+    UpdateBlockRange(image, blocks, updated[k], image.blocksRange);
+  }
+
+  constexpr size_t N = ChunkedMesh::CHUNK_BLOCKS;
+  std::vector<uint8_t> dirty(mesh.chunks.size(), 0);
+  for (const size_t b : updated) {
+    size_t index[3];
+    blocks.Index(b, index);
+    dirty[mesh.LinearIndex(index[0] / N, index[1] / N, index[2] / N)] = 1;
+  }
+  for (size_t z = 0; z < mesh.size[2]; ++z) {
+    for (size_t y = 0; y < mesh.size[1]; ++y) {
+      for (size_t x = 0; x < mesh.size[0]; ++x) {
+        const size_t c = mesh.LinearIndex(x, y, z);
+        ChunkedMesh::Chunk &chunk = mesh.chunks[c];
+        if (dirty[c]) {
+          PolygoniseChunk(image, blocks, image.blocksRange, x, y, z, chunk.lod,
+                          chunk.transitions, isolevel, chunk.mesh);
+          chunk.dirty = true;
+        }
+      }
+    }
+  }
+}
+
+void SetChunksLod(const Image3D &image, const std::vector<uint8_t> &chunksLods,
+                  ChunkedMesh &mesh) {
+  const float isolevel = 0;
+  assert(chunksLods.size() == mesh.chunks.size());
+  const int64_t size[3] = {int64_t(mesh.size[0]), int64_t(mesh.size[1]),
+                           int64_t(mesh.size[2])};
+  // the neighbour chunk across the face f (-x, +x, -y, +y, -z, +z), or -1.
+  const auto Neighbour = [&](size_t c, size_t f) {
+    int64_t index[3] = {int64_t(c % mesh.size[0]),
+                        int64_t((c / mesh.size[0]) % mesh.size[1]),
+                        int64_t(c / (mesh.size[0] * mesh.size[1]))};
+    index[f / 2] += (f & 1) ? 1 : -1;
+    if (index[f / 2] < 0 || index[f / 2] >= size[f / 2]) {
+      return int64_t(-1);
+    }
+    return int64_t(mesh.LinearIndex(index[0], index[1], index[2]));
   };
 
-#define USE_DUPLICATE_VERTICES
-  std::unordered_map<Vec3f, size_t, Vec3fHash> pointsHashTable;
-
-  auto InsertVertex = [&](const Vec3f &v) {
-#ifdef USE_DUPLICATE_VERTICES
-    size_t size = mesh.vertices.size();
-    mesh.vertices.push_back(v);
-    return size;
-#else
-    auto itr = pointsHashTable.find(v);
-    if (itr == pointsHashTable.end()) {
-      size_t size = mesh.vertices.size();
-      mesh.vertices.push_back(v);
-      pointsHashTable[v] = size;
-      return size;
-    }
-    return itr->second;
-#endif
+  // transition cells join chunks one lod apart only.
+  struct Lods;
+  struct Updated;
+  std::vector<uint8_t> &lods = ScratchVector<Lods, uint8_t>();
+  std::vector<size_t> &updated = ScratchVector<Updated, size_t>();
+  lods.resize(chunksLods.size());
+  for (size_t c = 0; c < lods.size(); ++c) {
+    lods[c] = (std::min)(chunksLods[c], ChunkedMesh::MAX_LOD);
+  }
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (size_t c = 0; c < lods.size(); ++c) {
+      for (size_t f = 0; f < 6; ++f) {
+        const int64_t n = Neighbour(c, f);
+        if (n >= 0 && lods[c] > lods[n] + 1) {
+          lods[c] = lods[n] + 1;
+          changed = true;
+        }
+      }
+    }
+  }
+
+  updated.clear();
+  for (size_t c = 0; c < lods.size(); ++c) {
+    uint8_t transitions = 0;
+    for (size_t f = 0; f < 6; ++f) {
+      const int64_t n = Neighbour(c, f);
+      if (n >= 0 && lods[n] < lods[c]) {
+        transitions |= 1 << f;
+      }
+    }
+    ChunkedMesh::Chunk &chunk = mesh.chunks[c];
+    if (chunk.lod != lods[c] || chunk.transitions != transitions) {
+      chunk.lod = lods[c];
+      chunk.transitions = transitions;
+      updated.push_back(c);
+    }
+  }
+  if (updated.empty()) {
+    return;
+  }
+
+  TIME_BLOCK("Chunks lod update")
+  const CellBlocks blocks(image);
+  const bool hasBlocksRange = image.blocksRange.min.size() == blocks.Count();
+  const BlocksRange blocksRange =
+      hasBlocksRange ? BlocksRange{} : CalculateBlocksRange(image);
+  const BlocksRange &range = hasBlocksRange ? image.blocksRange : blocksRange;
+  const int64_t updatedCount = updated.size();
+#pragma omp parallel for schedule(dynamic)
+  for (int64_t k = 0; k < updatedCount; ++k) {
+    const size_t c = updated[k];
+    ChunkedMesh::Chunk &chunk = mesh.chunks[c];
+    PolygoniseChunk(image, blocks, range, c % mesh.size[0],
+                    (c / mesh.size[0]) % mesh.size[1],
+                    c / (mesh.size[0] * mesh.size[1]), chunk.lod,
+                    chunk.transitions, isolevel, chunk.mesh);
+    chunk.dirty = true;
+  }
+}
+
+Mesh SurfaceNets(const Image3D &image) {
+  Mesh mesh;
+  SurfaceNets(image, mesh);
+  return mesh;
+}
+
+void SurfaceNets(const Image3D &image, Mesh &mesh) {
+  constexpr size_t BLOCK_CELLS = CellBlocks::BLOCK_SIZE *
+                                 CellBlocks::BLOCK_SIZE *
+                                 CellBlocks::BLOCK_SIZE;
+  constexpr uint32_t NO_VERTEX = UINT32_MAX;
+  const float isolevel = 0;
+  const Color YELLOW{255, 255, 0, 255};
+  mesh.id = GenerateID();
+  mesh.color = YELLOW;
+  mesh.visible = true;
+
+  TIME_BLOCK("Surface nets generation")
+
+  const CellBlocks blocks(image);
+  struct Active;
+  std::vector<size_t> &activeBlocks = ScratchVector<Active, size_t>();
+  ActiveBlocks(image, blocks, isolevel, activeBlocks);
+  const int64_t activeCount = activeBlocks.size();
+
+  // every active block owns a slot holding the vertex index of its cells.
+  struct BlockSlot;
+  std::vector<int64_t> &blockSlot = ScratchVector<BlockSlot, int64_t>();
+  blockSlot.assign(blocks.Count(), -1);
+  for (int64_t b = 0; b < activeCount; ++b) {
+    blockSlot[activeBlocks[b]] = b;
+  }
+  struct CellVertices;
+  std::vector<uint32_t> &cellVertex = ScratchVector<CellVertices, uint32_t>();
+  cellVertex.assign(activeCount * BLOCK_CELLS, NO_VERTEX);
+  auto CellVertex = [&](size_t x, size_t y, size_t z) -> uint32_t & {
+    const size_t block = blockSlot[blocks.BlockOf(x, y, z)];
+    const size_t local = x % CellBlocks::BLOCK_SIZE +
+                         (y % CellBlocks::BLOCK_SIZE) * CellBlocks::BLOCK_SIZE +
+                         (z % CellBlocks::BLOCK_SIZE) * CellBlocks::BLOCK_SIZE *
+                             CellBlocks::BLOCK_SIZE;
+    return cellVertex[block * BLOCK_CELLS + local];
   };
 
-  auto SetGridPoint = [](Grid &grid, const Image3D &image, size_t i, size_t x,
-                         size_t y, size_t z) {
-    grid.val[i] = image.At(x, y, z);
-    grid.p[i].x = image.origin[0] + x * image.spacing[0];
-    grid.p[i].y = image.origin[1] + y * image.spacing[1];
-    grid.p[i].z = image.origin[2] + z * image.spacing[2];
+  // the quad of a grid edge going from (x, y, z) along `axis` joins the 4
+  // cells around it, the edge is owned by the cell (x, y, z).
+  auto HasQuad = [&](size_t x, size_t y, size_t z, size_t axis) {
+    const size_t p[3] = {x, y, z};
+    for (size_t i = 1; i < 3; ++i) {
+      if (p[(axis + i) % 3] == 0) {
+        return false;
+      }
+    }
+    size_t q[3] = {x, y, z};
+    q[axis]++;
+    const bool inside0 = image.At(x, y, z) < isolevel;
+    const bool inside1 = image.At(q[0], q[1], q[2]) < isolevel;
+    return inside0 != inside1;
   };
 
-  for (size_t z = 0; z < image.size[2] - 1; z++) {
-    for (size_t y = 0; y < image.size[1] - 1; y++) {
-      for (size_t x = 0; x < image.size[0] - 1; x++) {
-        Grid grid;
-        SetGridPoint(grid, image, 0, x, y, z);
-        SetGridPoint(grid, image, 1, x + 1, y, z);
-        SetGridPoint(grid, image, 2, x + 1, y, z + 1);
-        SetGridPoint(grid, image, 3, x, y, z + 1);
-        SetGridPoint(grid, image, 4, x, y + 1, z);
-        SetGridPoint(grid, image, 5, x + 1, y + 1, z);
-        SetGridPoint(grid, image, 6, x + 1, y + 1, z + 1);
-        SetGridPoint(grid, image, 7, x, y + 1, z + 1);
-        /*
-            Determine the index into the edge table which
-            tells us which vertices are inside of the surface
-        */
-        int cubeindex = 0;
-        if (grid.val[0] < isolevel)
-          cubeindex |= 1;
-        if (grid.val[1] < isolevel)
-          cubeindex |= 2;
-        if (grid.val[2] < isolevel)
-          cubeindex |= 4;
-        if (grid.val[3] < isolevel)
-          cubeindex |= 8;
-        if (grid.val[4] < isolevel)
-          cubeindex |= 16;
-        if (grid.val[5] < isolevel)
-          cubeindex |= 32;
-        if (grid.val[6] < isolevel)
-          cubeindex |= 64;
-        if (grid.val[7] < isolevel)
-          cubeindex |= 128;
-
-        /* Cube is entirely in/out of the surface */
-        if (edgeTable[cubeindex] == 0) {
+  // first pass: count the vertices and quads generated by every block.
+  struct VertexOffsets;
+  struct FaceOffsets;
+  std::vector<size_t> &vertexOffsets = ScratchVector<VertexOffsets, size_t>();
+  std::vector<size_t> &faceOffsets = ScratchVector<FaceOffsets, size_t>();
+  vertexOffsets.assign(activeCount + 1, 0);
+  faceOffsets.assign(activeCount + 1, 0);
+#pragma omp parallel for schedule(dynamic)
+  for (int64_t b = 0; b < activeCount; ++b) {
+    size_t begin[3], end[3];
+    blocks.Range(activeBlocks[b], begin, end);
+    size_t vertices = 0, quads = 0;
+    uint8_t cubeIndices[CellBlocks::BLOCK_SIZE];
+    for (size_t z = begin[2]; z < end[2]; z++) {
+      for (size_t y = begin[1]; y < end[1]; y++) {
+        if (!ClassifyRow(image, y, z, begin[0], end[0], isolevel,
+                         cubeIndices)) {
           continue;
         }
+        for (size_t x = begin[0]; x < end[0]; x++) {
+          const int cubeindex = cubeIndices[x - begin[0]];
+          if (edgeTable[cubeindex] == 0) {
+            continue;
+          }
+          vertices++;
+          for (size_t axis = 0; axis < 3; ++axis) {
+            quads += HasQuad(x, y, z, axis);
+          }
+        }
+      }
+    }
+    vertexOffsets[b + 1] = vertices;
+    faceOffsets[b + 1] = 2 * quads;
+  }
+  for (int64_t b = 0; b < activeCount; ++b) {
+    vertexOffsets[b + 1] += vertexOffsets[b];
+    faceOffsets[b + 1] += faceOffsets[b];
+  }
+  mesh.vertices.resize(vertexOffsets[activeCount]);
+  mesh.faces.resize(faceOffsets[activeCount]);
+
+  // second pass: place one vertex per cell at the mean of its edge crossings.
+#pragma omp parallel for schedule(dynamic)
+  for (int64_t b = 0; b < activeCount; ++b) {
+    size_t begin[3], end[3];
+    blocks.Range(activeBlocks[b], begin, end);
+    size_t vertex = vertexOffsets[b];
+    uint8_t cubeIndices[CellBlocks::BLOCK_SIZE];
+    for (size_t z = begin[2]; z < end[2]; z++) {
+      for (size_t y = begin[1]; y < end[1]; y++) {
+        if (!ClassifyRow(image, y, z, begin[0], end[0], isolevel,
+                         cubeIndices)) {
+          continue;
+        }
+        for (size_t x = begin[0]; x < end[0]; x++) {
+          const int cubeindex = cubeIndices[x - begin[0]];
+          if (edgeTable[cubeindex] == 0) {
+            continue;
+          }
+          const Grid grid = LoadCell(image, x, y, z);
+          Vec3f sum{0, 0, 0};
+          size_t count = 0;
+          for (size_t e = 0; e < 12; ++e) {
+            if (edgeTable[cubeindex] & (1 << e)) {
+              sum = sum + EdgeIntersection(grid, e, isolevel);
+              count++;
+            }
+          }
+          mesh.vertices[vertex] = sum * (1.0f / count);
+          CellVertex(x, y, z) = uint32_t(vertex);
+          vertex++;
+        }
+      }
+    }
+    assert(vertex == vertexOffsets[b + 1]);
+  }
 
-        Vec3f vertexList[12] = {};
-
-        /* Find the vertices where the surface intersects the cube */
-        if (edgeTable[cubeindex] & 1)
-          vertexList[0] =
-              Lerp(isolevel, grid.p[0], grid.p[1], grid.val[0], grid.val[1]);
-        if (edgeTable[cubeindex] & 2)
-          vertexList[1] =
-              Lerp(isolevel, grid.p[1], grid.p[2], grid.val[1], grid.val[2]);
-        if (edgeTable[cubeindex] & 4)
-          vertexList[2] =
-              Lerp(isolevel, grid.p[2], grid.p[3], grid.val[2], grid.val[3]);
-        if (edgeTable[cubeindex] & 8)
-          vertexList[3] =
-              Lerp(isolevel, grid.p[3], grid.p[0], grid.val[3], grid.val[0]);
-        if (edgeTable[cubeindex] & 16)
-          vertexList[4] =
-              Lerp(isolevel, grid.p[4], grid.p[5], grid.val[4], grid.val[5]);
-        if (edgeTable[cubeindex] & 32)
-          vertexList[5] =
-              Lerp(isolevel, grid.p[5], grid.p[6], grid.val[5], grid.val[6]);
-        if (edgeTable[cubeindex] & 64)
-          vertexList[6] =
-              Lerp(isolevel, grid.p[6], grid.p[7], grid.val[6], grid.val[7]);
-        if (edgeTable[cubeindex] & 128)
-          vertexList[7] =
-              Lerp(isolevel, grid.p[7], grid.p[4], grid.val[7], grid.val[4]);
-        if (edgeTable[cubeindex] & 256)
-          vertexList[8] =
-              Lerp(isolevel, grid.p[0], grid.p[4], grid.val[0], grid.val[4]);
-        if (edgeTable[cubeindex] & 512)
-          vertexList[9] =
-              Lerp(isolevel, grid.p[1], grid.p[5], grid.val[1], grid.val[5]);
-        if (edgeTable[cubeindex] & 1024)
-          vertexList[10] =
-              Lerp(isolevel, grid.p[2], grid.p[6], grid.val[2], grid.val[6]);
-        if (edgeTable[cubeindex] & 2048)
-          vertexList[11] =
-              Lerp(isolevel, grid.p[3], grid.p[7], grid.val[3], grid.val[7]);
-
-        /* Create the triangle */
-        for (int i = 0; triTable[cubeindex][i] != -1; i += 3) {
-          const Mesh::Triangle t{
-              (uint32_t)InsertVertex(vertexList[triTable[cubeindex][i]]),
-              (uint32_t)InsertVertex(vertexList[triTable[cubeindex][i + 1]]),
-              (uint32_t)InsertVertex(vertexList[triTable[cubeindex][i + 2]])};
-          mesh.faces.push_back(t);
+  // third pass: connect the vertices of the 4 cells around every crossed edge.
+#pragma omp parallel for schedule(dynamic)
+  for (int64_t b = 0; b < activeCount; ++b) {
+    size_t begin[3], end[3];
+    blocks.Range(activeBlocks[b], begin, end);
+    size_t face = faceOffsets[b];
+    for (size_t z = begin[2]; z < end[2]; z++) {
+      for (size_t y = begin[1]; y < end[1]; y++) {
+        for (size_t x = begin[0]; x < end[0]; x++) {
+          if (CellVertex(x, y, z) == NO_VERTEX) {
+            continue;
+          }
+          for (size_t axis = 0; axis < 3; ++axis) {
+            if (!HasQuad(x, y, z, axis)) {
+              continue;
+            }
+            const size_t u = (axis + 1) % 3;
+            const size_t v = (axis + 2) % 3;
+            size_t c[4][3] = {{x, y, z}, {x, y, z}, {x, y, z}, {x, y, z}};
+            c[0][u]--, c[0][v]--;
+            c[1][v]--;
+            c[3][u]--;
+            uint32_t q[4];
+            for (size_t i = 0; i < 4; ++i) {
+              q[i] = CellVertex(c[i][0], c[i][1], c[i][2]);
+              assert(q[i] != NO_VERTEX);
+            }
+            // keep the same winding as the marching cubes triangles.
+            if (image.At(x, y, z) >= isolevel) {
+              std::swap(q[1], q[3]);
+            }
+            // split the quad along its shortest diagonal.
+            const float d02 =
+                Length2(mesh.vertices[q[0]] - mesh.vertices[q[2]]);
+            const float d13 =
+                Length2(mesh.vertices[q[1]] - mesh.vertices[q[3]]);
+            if (d02 <= d13) {
+              mesh.faces[face++] = Mesh::Triangle{q[0], q[1], q[2]};
+              mesh.faces[face++] = Mesh::Triangle{q[0], q[2], q[3]};
+            } else {
+              mesh.faces[face++] = Mesh::Triangle{q[0], q[1], q[3]};
+              mesh.faces[face++] = Mesh::Triangle{q[1], q[2], q[3]};
+            }
+          }
         }
       }
     }
+    assert(face == faceOffsets[b + 1]);
   }
-  return mesh;
+  mesh.box = CalculateBBox(mesh.vertices.data(), mesh.vertices.size());
 }
 
-std::vector<CheeseSlice> Slice(const Mesh &mesh, size_t slicesCount,
-                               Orientation direction) {
-  TIME_BLOCK("Slicing cheese")
+void SliceSet::Clear() {
+  starts.clear();
+  ends.clear();
+  segmentOffsets.assign(1, 0);
+  contourOffsets.assign(1, 0);
+  contourSegments.assign(1, 0);
+  contourAreas.clear();
+  contourClosed.clear();
+  boxes.clear();
+  positions.clear();
+}
+
+SliceSet Slice(const Mesh &mesh, size_t slicesCount, Orientation direction) {
+  SliceSet slices;
+  Slice(mesh, slicesCount, direction, slices);
+  return slices;
+}
+
+void Slice(const Mesh &mesh, size_t slicesCount, Orientation direction,
+           SliceSet &slices) {
   const BBox box = CalculateBBox(mesh);
   const size_t dir = size_t(direction);
-  const float length = box.Size()[dir];
-  const float step = length / slicesCount;
-
-  Vec3f normal = Vec3f{0, 0, 0};
+  // the origin is 0 along the frame axes, so the points keep their
+  // coordinates.
+  Vec3f origin{0, 0, 0};
+  origin[dir] = box.min[dir];
+  Vec3f normal{0, 0, 0};
   normal[dir] = 1;
+  Vec3f u{0, 0, 0};
+  u[(dir + 1) % 3] = 1;
+  Slice(mesh, origin, normal, u, box.Size()[dir] / slicesCount, slicesCount,
+        slices);
+}
 
-  std::vector<CheeseSlice> slices(slicesCount);
+SliceSet Slice(const Mesh &mesh, const Vec3f &origin, const Vec3f &normal,
+               const Vec3f &u, float step, size_t slicesCount) {
+  SliceSet slices;
+  Slice(mesh, origin, normal, u, step, slicesCount, slices);
+  return slices;
+}
+
+void Slice(const Mesh &mesh, const Vec3f &origin, const Vec3f &normal,
+           const Vec3f &u, float step, size_t slicesCount,
+           SliceSet &slices) {
+  struct Positions;
+  std::vector<float> &positions = ScratchVector<Positions, float>();
+  positions.resize(slicesCount);
+  for (size_t i = 0; i < slicesCount; ++i) {
+    positions[i] = step * i;
+  }
+  Slice(mesh, origin, normal, u, positions, slices);
+}
+
+void Slice(const Mesh &mesh, const Vec3f &origin, const Vec3f &planesNormal,
+           const Vec3f &uHint, const std::vector<float> &positions,
+           SliceSet &slices) {
+  TIME_BLOCK("Slicing cheese")
+  const size_t slicesCount = positions.size();
+  // a zero or non-finite normal has no planes.
+  const float normalLength2 = Length2(planesNormal);
+  if (slicesCount == 0 || !(normalLength2 > 0) ||
+      !std::isfinite(normalLength2)) {
+    slices.Clear();
+    return;
+  }
+  assert(std::is_sorted(positions.begin(), positions.end()));
+  // the frame of the planes is right handed so that the contours keep their
+  // winding.
+  const Vec3f normal = Normalised(planesNormal);
+  Vec3f u = uHint - normal * DotProduct(uHint, normal);
+  if (!(Length2(u) > 0)) {
+    u = std::abs(normal.x) < 0.9f ? Vec3f{1, 0, 0} : Vec3f{0, 1, 0};
+    u = u - normal * DotProduct(u, normal);
+  }
+  u = Normalised(u);
+  const Vec3f v = CrossProduct(normal, u);
+  const float originDistance = DotProduct(origin, normal);
+
+  // every face is listed in the rows of the planes its extent along normal
+  // spans, found by binary search with one plane of margin for the rounding,
+  // so that each plane only intersects the faces it may cross. The rows keep
+  // the faces order.
+  const int64_t facesCount = mesh.faces.size();
+  const int64_t lastPlane = int64_t(slicesCount) - 1;
+  struct FirstPlanes;
+  struct LastPlanes;
+  std::vector<uint32_t> &firstPlanes = ScratchVector<FirstPlanes, uint32_t>();
+  std::vector<uint32_t> &lastPlanes = ScratchVector<LastPlanes, uint32_t>();
+  firstPlanes.resize(facesCount);
+  lastPlanes.resize(facesCount);
 #pragma omp parallel for
-  for (int i = 0; i < slicesCount; ++i) {
-    CheeseSlice &slice = slices[i];
-    const Vec3f plane_point = box.min + normal * step * i;
-    for (const auto &t : mesh.faces) {
-      const Vec3f pts[3] = {
-          mesh.vertices[t[0]],
-          mesh.vertices[t[1]],
-          mesh.vertices[t[2]],
-      };
+  for (int64_t i = 0; i < facesCount; ++i) {
+    const Mesh::Triangle &t = mesh.faces[i];
+    const float a = DotProduct(mesh.vertices[t[0]], normal);
+    const float b = DotProduct(mesh.vertices[t[1]], normal);
+    const float c = DotProduct(mesh.vertices[t[2]], normal);
+    const float lo = (std::min)({a, b, c}) - originDistance;
+    const float hi = (std::max)({a, b, c}) - originDistance;
+    const int64_t first =
+        std::lower_bound(positions.begin(), positions.end(), lo) -
+        positions.begin() - 1;
+    const int64_t last =
+        std::upper_bound(positions.begin(), positions.end(), hi) -
+        positions.begin();
+    firstPlanes[i] = std::clamp<int64_t>(first, 0, lastPlane);
+    lastPlanes[i] = std::clamp<int64_t>(last, 0, lastPlane);
+  }
+
+  struct Offsets;
+  struct Items;
+  std::vector<uint32_t> &offsets = ScratchVector<Offsets, uint32_t>();
+  std::vector<uint32_t> &items = ScratchVector<Items, uint32_t>();
+  FillRows(
+      facesCount, slicesCount,
+      [&](size_t i, const auto &emit) {
+        for (uint32_t p = firstPlanes[i]; p <= lastPlanes[i]; ++p) {
+          emit(p);
+        }
+      },
+      offsets, items);
+
+  // the segments are counted first, then every plane writes its own range of
+  // the set.
+  const auto Crossed = [&](const Vec3f &planePoint, const Mesh::Triangle &t) {
+    // a face with a repeated vertex position only gives a zero length
+    // segment.
+    const Vec3f &a = mesh.vertices[t[0]];
+    const Vec3f &b = mesh.vertices[t[1]];
+    const Vec3f &c = mesh.vertices[t[2]];
+    if (a == b || b == c || c == a) {
+      return false;
+    }
+    return Crosses(planePoint, normal, a, b, c);
+  };
+  slices.positions.resize(slicesCount);
+  slices.segmentOffsets.assign(slicesCount + 1, 0);
+#pragma omp parallel for schedule(dynamic)
+  for (int64_t i = 0; i < int64_t(slicesCount); ++i) {
+    const Vec3f planePoint = origin + normal * positions[i];
+    uint32_t count = 0;
+    for (uint32_t k = offsets[i]; k < offsets[i + 1]; ++k) {
+      count += Crossed(planePoint, mesh.faces[items[k]]);
+    }
+    slices.segmentOffsets[i + 1] = count;
+    slices.positions[i] = originDistance + positions[i];
+  }
+  for (size_t i = 0; i < slicesCount; ++i) {
+    slices.segmentOffsets[i + 1] += slices.segmentOffsets[i];
+  }
+
+  const size_t segmentsCount = slices.segmentOffsets[slicesCount];
+  struct StartEdges;
+  struct EndEdges;
+  std::vector<uint64_t> &startEdges = ScratchVector<StartEdges, uint64_t>();
+  std::vector<uint64_t> &endEdges = ScratchVector<EndEdges, uint64_t>();
+  slices.starts.resize(segmentsCount);
+  slices.ends.resize(segmentsCount);
+  startEdges.resize(segmentsCount);
+  endEdges.resize(segmentsCount);
+#pragma omp parallel for schedule(dynamic)
+  for (int64_t i = 0; i < int64_t(slicesCount); ++i) {
+    const Vec3f planePoint = origin + normal * positions[i];
+    size_t segment = slices.segmentOffsets[i];
+    for (uint32_t k = offsets[i]; k < offsets[i + 1]; ++k) {
+      const Mesh::Triangle &t = mesh.faces[items[k]];
+      if (!Crossed(planePoint, t)) {
+        continue;
+      }
       Segment3D s3d;
-      if (Intersect(plane_point, normal, pts[0], pts[1], pts[2], s3d)) {
-        Segment2D s{};
-        s.start[0] = s3d.start[(dir + 1) % 3];
-        s.start[1] = s3d.start[(dir + 2) % 3];
-        s.end[0] = s3d.end[(dir + 1) % 3];
-        s.end[1] = s3d.end[(dir + 2) % 3];
-        slice.segments.push_back(s);
-        slice.box.Merge(Vec3f{s.start.x, s.start.y, 0});
-        slice.box.Merge(Vec3f{s.end.x, s.end.y, 0});
+      uint8_t startEdge, endEdge;
+      // the segment goes along normal x face normal, the material on its left.
+      Intersect(planePoint, normal, mesh.vertices[t[0]], mesh.vertices[t[1]],
+                mesh.vertices[t[2]], s3d, startEdge, endEdge);
+      // a point on the plane is keyed as the edge from that point to itself.
+      const auto Key = [&](uint8_t edge) {
+        const Vec3f &a = mesh.vertices[t[edge < 3 ? edge : edge - 3]];
+        return EdgeKey(a, edge < 3 ? mesh.vertices[t[(edge + 1) % 3]] : a);
+      };
+      startEdges[segment] = Key(startEdge);
+      endEdges[segment] = Key(endEdge);
+      slices.starts[segment] = Vec2f{DotProduct(s3d.start - origin, u),
+                                     DotProduct(s3d.start - origin, v)};
+      slices.ends[segment] = Vec2f{DotProduct(s3d.end - origin, u),
+                                   DotProduct(s3d.end - origin, v)};
+      ++segment;
+    }
+    assert(segment == slices.segmentOffsets[i + 1]);
+  }
+  BuildContours(startEdges, endEdges, slices);
+}
+
+std::vector<float> AdaptiveLayers(const Mesh &mesh, const Vec3f &direction,
+                                  float minThickness, float maxThickness,
+                                  float maxCusp) {
+  TIME_BLOCK("Adaptive layers")
+  const Vec3f normal = Normalised(direction);
+  const int64_t verticesCount = mesh.vertices.size();
+  const int64_t facesCount = mesh.faces.size();
+  float lo = FLT_MAX, hi = -FLT_MAX;
+#pragma omp parallel for reduction(min : lo) reduction(max : hi)
+  for (int64_t i = 0; i < verticesCount; ++i) {
+    const float d = DotProduct(mesh.vertices[i], normal);
+    lo = (std::min)(lo, d);
+    hi = (std::max)(hi, d);
+  }
+  std::vector<float> positions;
+  if (!(hi >= lo) || !(minThickness > 0) || !std::isfinite(minThickness) ||
+      !std::isfinite(maxThickness) || !std::isfinite(maxCusp)) {
+    return positions;
+  }
+  // the bins are capped to MAX_BINS, layers thinner than one bin would not
+  // follow the slopes any better.
+  constexpr float MAX_BINS = 1 << 16;
+  minThickness = (std::max)(minThickness, (hi - lo) / MAX_BINS);
+  maxThickness = (std::max)(maxThickness, minThickness);
+
+  // the slope of a face is |n . normal| for its unit normal n, the highest
+  // slope is kept in bins of minThickness along normal.
+  const size_t binsCount = size_t((hi - lo) / minThickness) + 1;
+  const auto Bin = [&](float d) {
+    // clamped as a float, the huge thicknesses overflowing size_t.
+    return size_t((std::min)((d - lo) / minThickness, float(binsCount - 1)));
+  };
+  struct Slopes;
+  struct FirstBins;
+  struct LastBins;
+  std::vector<float> &faceSlopes = ScratchVector<Slopes, float>();
+  std::vector<uint32_t> &firstBins = ScratchVector<FirstBins, uint32_t>();
+  std::vector<uint32_t> &lastBins = ScratchVector<LastBins, uint32_t>();
+  faceSlopes.resize(facesCount);
+  firstBins.resize(facesCount);
+  lastBins.resize(facesCount);
+#pragma omp parallel for
+  for (int64_t i = 0; i < facesCount; ++i) {
+    const Mesh::Triangle &t = mesh.faces[i];
+    const Vec3f &a = mesh.vertices[t[0]];
+    const Vec3f &b = mesh.vertices[t[1]];
+    const Vec3f &c = mesh.vertices[t[2]];
+    const Vec3f n = CrossProduct(b - a, c - a);
+    const float length = Length(n);
+    faceSlopes[i] = length > 0 ? std::abs(DotProduct(n, normal)) / length : 0;
+    const float da = DotProduct(a, normal);
+    const float db = DotProduct(b, normal);
+    const float dc = DotProduct(c, normal);
+    firstBins[i] = Bin((std::min)({da, db, dc}));
+    lastBins[i] = Bin((std::max)({da, db, dc}));
+  }
+  std::vector<float> slopes(binsCount, 0);
+  ParallelScatter(
+      facesCount, slopes,
+      [&](size_t i, const auto &emit) {
+        for (size_t bin = firstBins[i]; bin <= lastBins[i]; ++bin) {
+          emit(bin);
+        }
+      },
+      [&](size_t i, const auto &emit) {
+        for (size_t bin = firstBins[i]; bin <= lastBins[i]; ++bin) {
+          emit(bin, faceSlopes[i]);
+        }
+      },
+      [](float &slope, float s) { slope = (std::max)(slope, s); });
+
+  // a layer starts as thick as allowed and gets thinner as the bins it covers
+  // are scanned upward, until the next bin lies above it, so every layer only
+  // scans the bins it covers.
+  for (float position = lo; position <= hi;) {
+    positions.push_back(position);
+    float thickness = maxThickness;
+    float slope = 0;
+    for (size_t bin = Bin(position); bin <= Bin(position + thickness); ++bin) {
+      slope = (std::max)(slope, slopes[bin]);
+      if (slope > 0) {
+        thickness = std::clamp(maxCusp / slope, minThickness, maxThickness);
       }
     }
+    // far from the origin, a thin layer may not move a float position.
+    if (!(position + thickness > position)) {
+      break;
+    }
+    position += thickness;
   }
+  return positions;
+}
+
+SliceSet MarchingSquares(const Image3D &image, Orientation direction,
+                         float first, float step, size_t slicesCount) {
+  SliceSet slices;
+  MarchingSquares(image, direction, first, step, slicesCount, slices);
   return slices;
 }
+
+void MarchingSquares(const Image3D &image, Orientation direction, float first,
+                     float step, size_t slicesCount, SliceSet &slices) {
+  TIME_BLOCK("Marching squares")
+  const size_t dir = size_t(direction);
+  if (slicesCount == 0 || image.size[dir] < 2) {
+    slices.Clear();
+    return;
+  }
+  const size_t u = (dir + 1) % 3;
+  const size_t v = (dir + 2) % 3;
+  const size_t nu = image.size[u];
+  const size_t nv = image.size[v];
+  const float origin[2] = {image.origin[u], image.origin[v]};
+  const float spacing[2] = {image.spacing[u], image.spacing[v]};
+  const float lastLayer = image.size[dir] - 1;
+
+  // the plane samples are interpolated between the grid layers around it,
+  // the planes out of the grid take its border layer.
+  const auto Sample = [&](size_t i, float *layer) {
+    const float position = first + step * i;
+    const float layerPosition = std::clamp(
+        (position - image.origin[dir]) / image.spacing[dir], 0.0f, lastLayer);
+    const size_t k = (std::min)(size_t(layerPosition), image.size[dir] - 2);
+    const float w = layerPosition - k;
+    size_t p[3];
+    for (size_t b = 0; b < nv; ++b) {
+      for (size_t a = 0; a < nu; ++a) {
+        p[u] = a;
+        p[v] = b;
+        p[dir] = k;
+        const float v0 = image.At(p[0], p[1], p[2]);
+        p[dir] = k + 1;
+        const float v1 = image.At(p[0], p[1], p[2]);
+        layer[a + b * nu] = v0 + w * (v1 - v0);
+      }
+    }
+    return position;
+  };
+  MarchPlanes(slicesCount, nu, nv, origin, spacing, Sample, slices);
+}
+
+SliceSet MarchingSquares(const Cheese &cheese, const float min[3],
+                         const float max[3], const float spacing[3],
+                         Orientation direction, float first, float step,
+                         size_t slicesCount) {
+  SliceSet slices;
+  MarchingSquares(cheese, min, max, spacing, direction, first, step,
+                  slicesCount, slices);
+  return slices;
+}
+
+void MarchingSquares(const Cheese &cheese, const float min[3],
+                     const float max[3], const float spacing[3],
+                     Orientation direction, float first, float step,
+                     size_t slicesCount, SliceSet &slices) {
+  TIME_BLOCK("Marching squares")
+  if (slicesCount == 0) {
+    slices.Clear();
+    return;
+  }
+  const size_t dir = size_t(direction);
+  const size_t u = (dir + 1) % 3;
+  const size_t v = (dir + 2) % 3;
+  const size_t nu = size_t((max[u] - min[u]) / spacing[u]) + 1;
+  const size_t nv = size_t((max[v] - min[v]) / spacing[v]) + 1;
+  const float origin[2] = {min[u], min[v]};
+  const float planeSpacing[2] = {spacing[u], spacing[v]};
+
+  const auto Sample = [&](size_t i, float *layer) {
+    float p[3];
+    p[dir] = first + step * i;
+    for (size_t b = 0; b < nv; ++b) {
+      for (size_t a = 0; a < nu; ++a) {
+        p[u] = min[u] + spacing[u] * a;
+        p[v] = min[v] + spacing[v] * b;
+        layer[a + b * nu] = cheese.Eval(p[0], p[1], p[2]);
+      }
+    }
+    return p[dir];
+  };
+  MarchPlanes(slicesCount, nu, nv, origin, planeSpacing, Sample, slices);
+}
+
+void SimplifyContours(SliceSet &slices, float tolerance) {
+  TIME_BLOCK("Simplifying contours")
+  if (!(tolerance > 0)) {
+    return;
+  }
+  const int64_t slicesCount = slices.Count();
+  const int64_t contoursCount = slices.ContoursCount();
+  const float tolerance2 = tolerance * tolerance;
+  // kept[k] tells if the start of segment k is kept, every kept point starts
+  // one of the new segments.
+  struct Kept;
+  struct Counts;
+  std::vector<uint8_t> &kept = ScratchVector<Kept, uint8_t>();
+  std::vector<uint32_t> &counts = ScratchVector<Counts, uint32_t>();
+  kept.assign(slices.starts.size(), false);
+  counts.resize(contoursCount + 1);
+  counts[0] = 0;
+#pragma omp parallel for schedule(dynamic)
+  for (int64_t c = 0; c < contoursCount; ++c) {
+    const size_t first = slices.contourSegments[c];
+    const size_t last = slices.contourSegments[c + 1];
+    const size_t n = last - first;
+    uint8_t *contourKept = kept.data() + first;
+    contourKept[0] = true;
+    if (slices.contourClosed[c]) {
+      // a closed contour is split at its farthest point from the first one,
+      // and keeps a third point so that it doesn't collapse.
+      const auto Point = [&](size_t k) { return slices.starts[first + k % n]; };
+      size_t far = 0;
+      for (size_t k = 1; k < n; ++k) {
+        if (Length2(Point(k) - Point(0)) > Length2(Point(far) - Point(0))) {
+          far = k;
+        }
+      }
+      if (far != 0) {
+        contourKept[far] = true;
+        SimplifyPolyline(Point, 0, far, tolerance2, contourKept);
+        SimplifyPolyline(Point, far, n, tolerance2, contourKept);
+        if (std::count(contourKept, contourKept + n, true) < 3) {
+          size_t third = 0;
+          float thirdDistance = -1;
+          for (size_t k = 1; k < n; ++k) {
+            const float d =
+                PointToSegmentDistance2(Point(k), Point(0), Point(far));
+            if (k != far && d > thirdDistance) {
+              third = k;
+              thirdDistance = d;
+            }
+          }
+          contourKept[third] = true;
+        }
+      }
+    } else {
+      const auto Point = [&](size_t k) {
+        return k < n ? slices.starts[first + k] : slices.ends[last - 1];
+      };
+      SimplifyPolyline(Point, 0, n, tolerance2, contourKept);
+    }
+    counts[c + 1] = std::count(contourKept, contourKept + n, true);
+  }
+  for (int64_t c = 0; c < contoursCount; ++c) {
+    counts[c + 1] += counts[c];
+  }
+
+  // the new segments join the kept points, the last one goes back to the
+  // first point of a closed contour, and to the end of an open one.
+  // the unsimplified segments are freed with these buffers.
+  std::vector<Vec2f> starts(counts[contoursCount]);
+  std::vector<Vec2f> ends(counts[contoursCount]);
+#pragma omp parallel for schedule(dynamic)
+  for (int64_t c = 0; c < contoursCount; ++c) {
+    const size_t first = slices.contourSegments[c];
+    const size_t last = slices.contourSegments[c + 1];
+    size_t segment = counts[c];
+    for (size_t k = first; k < last; ++k) {
+      if (kept[k]) {
+        starts[segment++] = slices.starts[k];
+      }
+    }
+    for (size_t k = counts[c]; k + 1 < counts[c + 1]; ++k) {
+      ends[k] = starts[k + 1];
+    }
+    ends[counts[c + 1] - 1] =
+        slices.contourClosed[c] ? starts[counts[c]] : slices.ends[last - 1];
+  }
+  slices.starts.swap(starts);
+  slices.ends.swap(ends);
+  std::copy(counts.begin(), counts.end(), slices.contourSegments.begin());
+  for (int64_t i = 0; i <= slicesCount; ++i) {
+    slices.segmentOffsets[i] =
+        slices.contourSegments[slices.contourOffsets[i]];
+  }
+  CalculateContoursShape(slices);
+}